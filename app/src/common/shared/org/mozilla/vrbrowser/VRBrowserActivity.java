@@ -13,6 +13,7 @@ import android.graphics.Canvas;
 import android.graphics.Color;
 import android.graphics.Paint;
 import android.graphics.PorterDuff;
+import android.graphics.Rect;
 import android.graphics.SurfaceTexture;
 import android.net.Uri;
 import android.opengl.GLES11Ext;
@@ -53,6 +54,7 @@ import org.mozilla.vrbrowser.ui.widgets.RootWidget;
 import org.mozilla.vrbrowser.ui.widgets.TopBarWidget;
 import org.mozilla.vrbrowser.ui.widgets.TrayListener;
 import org.mozilla.vrbrowser.ui.widgets.TrayWidget;
+import org.mozilla.vrbrowser.ui.widgets.UIAtlasRenderer;
 import org.mozilla.vrbrowser.ui.widgets.UIWidget;
 import org.mozilla.vrbrowser.ui.widgets.VideoProjectionMenuWidget;
 import org.mozilla.vrbrowser.ui.widgets.Widget;
@@ -63,6 +65,8 @@ import org.mozilla.vrbrowser.ui.widgets.dialogs.CrashDialogWidget;
 
 import java.io.IOException;
 import java.net.URISyntaxException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.LinkedList;
@@ -102,8 +106,26 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     static final int GestureSwipeRight = 1;
     static final int SwipeDelay = 1000; // milliseconds
 
+    // Must match BrowserEventType and BrowserEvent in BrowserEventQueue.h
+    static final int BrowserEventMotion = 0;
+    static final int BrowserEventScroll = 1;
+    static final int BrowserEventGesture = 2;
+    static final int BrowserEventResize = 3;
+    static final int BrowserEventBack = 4;
+    static final int BrowserEventSize = 24; // bytes
+    static final int BrowserEventBatch = 64;
+    static final int BrowserEventTimeout = 100; // milliseconds
+    static final int AudioUpdateInterval = 8; // milliseconds, faster than the display refresh
+    static final int AudioIdleUpdateInterval = 250; // milliseconds, while no sound is playing
+    // Must match crow::TelemetryMetric.
+    public static final int TelemetryFrameIdDelta = 0;
+    public static final int TelemetryFrameWait = 1;
+    public static final int TelemetryBlit = 2;
+    public static final int TelemetryPoseLatency = 3;
+
     static final String LOGTAG = "VRB";
     HashMap<Integer, Widget> mWidgets;
+    UIAtlasRenderer mAtlasRenderer;
     private int mWidgetHandleIndex = 1;
     AudioEngine mAudioEngine;
     OffscreenDisplay mOffscreenDisplay;
@@ -112,6 +134,9 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     SwipeRunnable mLastRunnable;
     Handler mHandler = new Handler();
     Runnable mAudioUpdateRunnable;
+    boolean mAudioUpdatesActive;
+    float[] mAudioPose = new float[7];
+    int mAudioPoseSequence;
     WindowWidget mWindowWidget;
     RootWidget mRootWidget;
     KeyboardWidget mKeyboard;
@@ -131,6 +156,7 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     private LinkedList<Pair<Object, Float>> mBrightnessQueue;
     private Pair<Object, Float> mCurrentBrightness;
     private SearchEngineWrapper mSearchEngineWrapper;
+    private BrowserEventThread mBrowserEventThread;
 
     @Override
     protected void onCreate(Bundle savedInstanceState) {
@@ -179,7 +205,31 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
             Log.i(LOGTAG, "AudioEngine sounds preloaded!");
             // mAudioEngine.playSound(AudioEngine.Sound.AMBIENT, true);
         });
-        mAudioUpdateRunnable = () -> mAudioEngine.update();
+        // https://developers.google.com/vr/reference/android/com/google/vr/sdk/audio/GvrAudioEngine.html#resume()
+        // The update method must be called from the main thread at a regular rate.
+        mAudioUpdateRunnable = new Runnable() {
+            @Override
+            public void run() {
+                // The head pose only matters while a sound is being spatialized.
+                boolean playing = mAudioEngine.isPlaying();
+                if (playing) {
+                    int sequence = readHeadPoseNative(mAudioPose);
+                    if (sequence != mAudioPoseSequence) {
+                        mAudioPoseSequence = sequence;
+                        mAudioEngine.setPose(mAudioPose[0], mAudioPose[1], mAudioPose[2], mAudioPose[3],
+                                mAudioPose[4], mAudioPose[5], mAudioPose[6]);
+                    }
+                }
+                mAudioEngine.update();
+                mHandler.postDelayed(this, playing ? AudioUpdateInterval : AudioIdleUpdateInterval);
+            }
+        };
+        mAudioEngine.setPlaybackListener(() -> mHandler.post(() -> {
+            if (mAudioUpdatesActive) {
+                mHandler.removeCallbacks(mAudioUpdateRunnable);
+                mAudioUpdateRunnable.run();
+            }
+        }));
 
         loadFromIntent(getIntent());
         queueRunnable(() -> createOffscreenDisplay());
@@ -192,6 +242,9 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         mSearchEngineWrapper.registerForUpdates();
 
         GeolocationWrapper.update(this);
+
+        mBrowserEventThread = new BrowserEventThread();
+        mBrowserEventThread.start();
     }
 
     protected void initializeWorld() {
@@ -257,6 +310,8 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
             // Also prevents a deadlock in onDestroy when the BrowserWidget is released.
             exitImmersiveSync();
         }
+        mAudioUpdatesActive = false;
+        mHandler.removeCallbacks(mAudioUpdateRunnable);
         mAudioEngine.pauseEngine();
         SessionStore.get().setActive(false);
         for (Widget widget: mWidgets.values()) {
@@ -269,6 +324,8 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     protected void onResume() {
         SessionStore.get().setActive(true);
         mAudioEngine.resumeEngine();
+        mAudioUpdatesActive = true;
+        mHandler.post(mAudioUpdateRunnable);
         for (Widget widget: mWidgets.values()) {
             widget.onResume();
         }
@@ -277,6 +334,8 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
 
     @Override
     protected void onDestroy() {
+        mBrowserEventThread.quit();
+
         // Unregister the crash service broadcast receiver
         unregisterReceiver(mCrashReceiver);
         mSearchEngineWrapper.unregisterForUpdates();
@@ -284,6 +343,10 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         for (Widget widget: mWidgets.values()) {
             widget.releaseWidget();
         }
+        if (mAtlasRenderer != null) {
+            mAtlasRenderer.release();
+            mAtlasRenderer = null;
+        }
 
         if (mOffscreenDisplay != null) {
             mOffscreenDisplay.release();
@@ -502,6 +565,41 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
 
     @Keep
     @SuppressWarnings("unused")
+    void dispatchCreateAtlasWidget(final int aHandle, final SurfaceTexture aTexture, final int aAtlasWidth, final int aAtlasHeight,
+                                   final int aX, final int aY, final int aWidth, final int aHeight) {
+        runOnUiThread(() -> {
+            final Widget widget = mWidgets.get(aHandle);
+            if (!(widget instanceof UIWidget)) {
+                Log.e(LOGTAG, "Widget " + aHandle + " not found");
+                return;
+            }
+            UIWidget atlasWidget = (UIWidget) widget;
+            if (aTexture == null) {
+                Log.d(LOGTAG, "Widget: " + aHandle + " received a null atlas surface texture.");
+                // Only leave the atlas, the renderer is shared with the other atlas widgets.
+                atlasWidget.setAtlas(null, null, null);
+                return;
+            }
+            if (mAtlasRenderer == null || !mAtlasRenderer.isFor(aTexture)) {
+                if (mAtlasRenderer != null) {
+                    mAtlasRenderer.release();
+                }
+                mAtlasRenderer = new UIAtlasRenderer(aTexture, aAtlasWidth, aAtlasHeight);
+            }
+            Runnable firstDrawCallback = () -> {
+                if (!widget.getFirstDraw()) {
+                    widget.setFirstDraw(true);
+                    updateWidget(widget);
+                }
+            };
+            atlasWidget.setAtlas(mAtlasRenderer, new Rect(aX, aY, aX + aWidth, aY + aHeight), firstDrawCallback);
+            // Add widget to a virtual display for invalidation
+            if (atlasWidget.getParent() == null) {
+                mWidgetContainer.addView(atlasWidget, new FrameLayout.LayoutParams(aWidth, aHeight));
+            }
+        });
+    }
+
     void handleMotionEvent(final int aHandle, final int aDevice, final boolean aPressed, final float aX, final float aY) {
         runOnUiThread(() -> {
             Widget widget = mWidgets.get(aHandle);
@@ -516,8 +614,6 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
     }
 
-    @Keep
-    @SuppressWarnings("unused")
     void handleScrollEvent(final int aHandle, final int aDevice, final float aX, final float aY) {
         runOnUiThread(() -> {
             Widget widget = mWidgets.get(aHandle);
@@ -529,8 +625,6 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
     }
 
-    @Keep
-    @SuppressWarnings("unused")
     void handleGesture(final int aType) {
         runOnUiThread(() -> {
             boolean consumed = false;
@@ -558,8 +652,6 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
     }
 
-    @SuppressWarnings({"UnusedDeclaration"})
-    @Keep
     void handleBack() {
         runOnUiThread(() -> {
             dispatchKeyEvent(new KeyEvent(KeyEvent.ACTION_DOWN, KeyEvent.KEYCODE_BACK));
@@ -567,24 +659,74 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         });
     }
 
-    @Keep
-    @SuppressWarnings({"UnusedDeclaration"})
-    void handleAudioPose(float qx, float qy, float qz, float qw, float px, float py, float pz) {
-        mAudioEngine.setPose(qx, qy, qz, qw, px, py, pz);
-
-        // https://developers.google.com/vr/reference/android/com/google/vr/sdk/audio/GvrAudioEngine.html#resume()
-        // The initialize method must be called from the main thread at a regular rate.
-        runOnUiThread(mAudioUpdateRunnable);
-    }
-
-    @Keep
-    @SuppressWarnings("unused")
     void handleResize(final int aHandle, final float aWorldWidth, final float aWorldHeight) {
         runOnUiThread(() -> {
             mWindowWidget.handleResizeEvent(aWorldWidth, aWorldHeight);
         });
     }
 
+    // Collects the events queued by the render thread. Events are copied in batches
+    // into a direct buffer so only one JNI transition is needed per batch.
+    class BrowserEventThread extends Thread {
+        private volatile boolean mRunning = true;
+
+        BrowserEventThread() {
+            super("BrowserEvents");
+        }
+
+        void quit() {
+            mRunning = false;
+            wakeBrowserEventsNative();
+            try {
+                join();
+            } catch (InterruptedException e) {
+                Log.e(LOGTAG, "Interrupted while stopping browser event thread");
+            }
+        }
+
+        @Override
+        public void run() {
+            ByteBuffer buffer = ByteBuffer.allocateDirect(BrowserEventSize * BrowserEventBatch).order(ByteOrder.nativeOrder());
+            float[] values = new float[2];
+            while (mRunning) {
+                int count = drainBrowserEventsNative(buffer, BrowserEventTimeout);
+                for (int index = 0; index < count; index++) {
+                    buffer.position(index * BrowserEventSize);
+                    final int type = buffer.getInt();
+                    final int handle = buffer.getInt();
+                    final int controller = buffer.getInt();
+                    final boolean pressed = buffer.getInt() != 0;
+                    for (int value = 0; value < values.length; value++) {
+                        values[value] = buffer.getFloat();
+                    }
+                    dispatchBrowserEvent(type, handle, controller, pressed, values);
+                }
+            }
+        }
+    }
+
+    private void dispatchBrowserEvent(int aType, int aHandle, int aController, boolean aPressed, float[] aValues) {
+        switch (aType) {
+            case BrowserEventMotion:
+                handleMotionEvent(aHandle, aController, aPressed, aValues[0], aValues[1]);
+                break;
+            case BrowserEventScroll:
+                handleScrollEvent(aHandle, aController, aValues[0], aValues[1]);
+                break;
+            case BrowserEventGesture:
+                handleGesture(aHandle);
+                break;
+            case BrowserEventResize:
+                handleResize(aHandle, aValues[0], aValues[1]);
+                break;
+            case BrowserEventBack:
+                handleBack();
+                break;
+            default:
+                Log.e(LOGTAG, "Unknown browser event type: " + aType);
+        }
+    }
+
     @Keep
     @SuppressWarnings("unused")
     void registerExternalContext(long aContext) {
@@ -983,6 +1125,38 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
         queueRunnable(this::resetUIYawNative);
     }
 
+    // Returns min, avg and p99 milliseconds for each native frame phase, in FramePhase order.
+    // Safe to call from any thread.
+    public float[] getFrameTimings() {
+        return getFrameTimingsNative();
+    }
+
+    public boolean dumpFrameTimings(String aPath) {
+        return dumpFrameTimingsNative(aPath);
+    }
+
+    // Returns count, p50, p90, p99 and max for each Telemetry* metric followed by the
+    // skipped and repeated frame counts of the current or last immersive session.
+    // Times are in microseconds. Safe to call from any thread.
+    public float[] getImmersiveTelemetry() {
+        return getImmersiveTelemetryNative();
+    }
+
+    // Returns pairs of bucket lower bound and sample count for a Telemetry* metric.
+    public long[] getImmersiveHistogram(int aMetric) {
+        return getImmersiveHistogramNative(aMetric);
+    }
+
+    public boolean dumpImmersiveTelemetry(String aPath) {
+        return dumpImmersiveTelemetryNative(aPath);
+    }
+
+    // Returns the GL state changes issued and skipped as redundant in the last frame,
+    // followed by the same counts since startup. Safe to call from any thread.
+    public long[] getGLStateCounters() {
+        return getGLStateCountersNative();
+    }
+
     private native void addWidgetNative(int aHandle, WidgetPlacement aPlacement);
     private native void updateWidgetNative(int aHandle, WidgetPlacement aPlacement);
     private native void removeWidgetNative(int aHandle);
@@ -999,4 +1173,13 @@ public class VRBrowserActivity extends PlatformActivity implements WidgetManager
     private native void resetUIYawNative();
     private native void setControllersVisibleNative(boolean aVisible);
     private native void runCallbackNative(long aCallback);
+    private native float[] getFrameTimingsNative();
+    private native boolean dumpFrameTimingsNative(String aPath);
+    private native float[] getImmersiveTelemetryNative();
+    private native long[] getImmersiveHistogramNative(int aMetric);
+    private native boolean dumpImmersiveTelemetryNative(String aPath);
+    private native long[] getGLStateCountersNative();
+    private native int readHeadPoseNative(float[] aPose);
+    private native int drainBrowserEventsNative(ByteBuffer aBuffer, int aTimeoutMs);
+    private native void wakeBrowserEventsNative();
 }
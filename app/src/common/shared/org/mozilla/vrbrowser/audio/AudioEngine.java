@@ -20,6 +20,7 @@ public class AudioEngine {
     private float mMasterVolume = 1.0f;
     private static ConcurrentHashMap<Context, AudioEngine> mEngines = new ConcurrentHashMap<>();
     private boolean mEnabled;
+    private Runnable mPlaybackListener;
     private static final String LOGTAG = "VRB";
 
     public enum SoundType {
@@ -69,6 +70,23 @@ public class AudioEngine {
         mEnabled = enabled;
     }
 
+    // Called on the thread that starts a sound, before it plays.
+    public void setPlaybackListener(Runnable aListener) {
+        mPlaybackListener = aListener;
+    }
+
+    public boolean isPlaying() {
+        if (!mEnabled) {
+            return false;
+        }
+        for (Integer sourceId: mSourceIds.values()) {
+            if (mEngine.isSoundPlaying(sourceId)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     private void preload() {
         for (Sound sound: Sound.values()) {
             if (sound.getType() == SoundType.FIELD) {
@@ -151,6 +169,9 @@ public class AudioEngine {
     }
 
     private void playSound(int aSourceId, boolean aLoopEnabled) {
+        if (mPlaybackListener != null) {
+            mPlaybackListener.run();
+        }
         mEngine.playSound(aSourceId, aLoopEnabled);
     }
 
@@ -67,6 +67,7 @@ public class TopBarWidget extends UIWidget implements SessionStore.SessionChange
         aPlacement.parentAnchorX = 0.5f;
         aPlacement.parentAnchorY = 1.0f;
         aPlacement.opaque = false;
+        aPlacement.atlas = true;
     }
 
     @Override
@@ -0,0 +1,93 @@
+/* -*- Mode: Java; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil; -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+package org.mozilla.vrbrowser.ui.widgets;
+
+import android.graphics.Canvas;
+import android.graphics.Color;
+import android.graphics.PorterDuff;
+import android.graphics.SurfaceTexture;
+import android.os.Handler;
+import android.os.Looper;
+import android.view.Surface;
+
+import java.util.ArrayList;
+
+// Draws the widgets that share the native widget atlas into its surface. Every posted
+// frame replaces the whole surface, so all widgets are drawn together, at most once
+// per UI thread pass no matter how many of them were invalidated.
+public class UIAtlasRenderer {
+    private SurfaceTexture mSurfaceTexture;
+    private Surface mSurface;
+    private ArrayList<UIWidget> mWidgets = new ArrayList<>();
+    private Handler mHandler = new Handler(Looper.getMainLooper());
+    private boolean mDrawPending;
+    private Runnable mDrawRunnable = this::draw;
+
+    public UIAtlasRenderer(SurfaceTexture aTexture, int aWidth, int aHeight) {
+        mSurfaceTexture = aTexture;
+        mSurfaceTexture.setDefaultBufferSize(aWidth, aHeight);
+        mSurface = new Surface(mSurfaceTexture);
+    }
+
+    public boolean isFor(SurfaceTexture aTexture) {
+        return mSurfaceTexture != null && mSurfaceTexture.equals(aTexture);
+    }
+
+    void add(UIWidget aWidget) {
+        if (!mWidgets.contains(aWidget)) {
+            mWidgets.add(aWidget);
+        }
+        requestDraw();
+    }
+
+    void remove(UIWidget aWidget) {
+        if (mWidgets.remove(aWidget)) {
+            requestDraw();
+        }
+    }
+
+    void requestDraw() {
+        if (!mDrawPending && mSurface != null) {
+            mDrawPending = true;
+            mHandler.post(mDrawRunnable);
+        }
+    }
+
+    public void release() {
+        mHandler.removeCallbacks(mDrawRunnable);
+        mDrawPending = false;
+        mWidgets.clear();
+        if (mSurface != null) {
+            mSurface.release();
+        }
+        if (mSurfaceTexture != null) {
+            mSurfaceTexture.release();
+        }
+        mSurface = null;
+        mSurfaceTexture = null;
+    }
+
+    private void draw() {
+        mDrawPending = false;
+        if (mSurface == null) {
+            return;
+        }
+        Canvas canvas;
+        try {
+            canvas = mSurface.lockHardwareCanvas();
+            canvas.drawColor(Color.TRANSPARENT, PorterDuff.Mode.CLEAR);
+        }
+        catch (Exception e) {
+            e.printStackTrace();
+            return;
+        }
+        // Copy, first draw callbacks may update widgets.
+        for (UIWidget widget: new ArrayList<>(mWidgets)) {
+            widget.drawInAtlas(canvas);
+        }
+        mSurface.unlockCanvasAndPost(canvas);
+    }
+}
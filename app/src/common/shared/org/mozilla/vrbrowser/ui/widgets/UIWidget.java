@@ -35,6 +35,8 @@ public abstract class UIWidget extends FrameLayout implements Widget {
     }
 
     protected UISurfaceTextureRenderer mRenderer;
+    protected UIAtlasRenderer mAtlas;
+    private Rect mAtlasSlot;
     protected SurfaceTexture mTexture;
     protected float mWorldWidth;
     protected int mHandle;
@@ -126,6 +128,48 @@ public abstract class UIWidget extends FrameLayout implements Widget {
         setWillNotDraw(mRenderer == null);
     }
 
+    // Draws the widget into aSlot of a shared atlas surface instead of its own surface.
+    public void setAtlas(UIAtlasRenderer aAtlas, Rect aSlot, Runnable aFirstDrawCallback) {
+        if (mAtlas != aAtlas) {
+            if (mAtlas != null) {
+                mAtlas.remove(this);
+            }
+            if (mRenderer != null) {
+                mRenderer.release();
+                mRenderer = null;
+            }
+            mTexture = null;
+            mAtlas = aAtlas;
+            if (mAtlas != null) {
+                mAtlas.add(this);
+            }
+        }
+        mAtlasSlot = aSlot;
+        mFirstDrawCallback = aFirstDrawCallback;
+        setWillNotDraw(mRenderer == null && mAtlas == null);
+        if (mAtlas != null) {
+            mAtlas.requestDraw();
+        }
+    }
+
+    void drawInAtlas(Canvas aCanvas) {
+        if (mAtlasSlot == null || getWidth() == 0 || getVisibility() != View.VISIBLE) {
+            return;
+        }
+        aCanvas.save();
+        aCanvas.translate(mAtlasSlot.left, mAtlasSlot.top);
+        aCanvas.clipRect(0, 0, mAtlasSlot.width(), mAtlasSlot.height());
+        // set the proper scale
+        float scale = mAtlasSlot.width() / (float)getWidth();
+        aCanvas.scale(scale, scale);
+        super.draw(aCanvas);
+        aCanvas.restore();
+        if (mFirstDrawCallback != null) {
+            mFirstDrawCallback.run();
+            mFirstDrawCallback = null;
+        }
+    }
+
     @Override
     public void resizeSurface(final int aWidth, final int aHeight) {
         if (mRenderer != null){
@@ -183,6 +227,10 @@ public abstract class UIWidget extends FrameLayout implements Widget {
             mRenderer.release();
             mRenderer = null;
         }
+        if (mAtlas != null) {
+            mAtlas.remove(this);
+            mAtlas = null;
+        }
         mTexture = null;
         mWidgetManager = null;
     }
@@ -199,6 +247,10 @@ public abstract class UIWidget extends FrameLayout implements Widget {
 
     @Override
     public void draw(Canvas aCanvas) {
+        if (mAtlas != null) {
+            mAtlas.requestDraw();
+            return;
+        }
         if (mRenderer == null) {
             super.draw(aCanvas);
             return;
@@ -221,7 +273,7 @@ public abstract class UIWidget extends FrameLayout implements Widget {
     @Override
     public void onDescendantInvalidated (View child, View target) {
         super.onDescendantInvalidated(child, target);
-        if (mRenderer != null) {
+        if (mRenderer != null || mAtlas != null) {
             // TODO: transform rect and use invalidate(dirty)
             postInvalidate();
         }
@@ -232,7 +284,7 @@ public abstract class UIWidget extends FrameLayout implements Widget {
     @Override
     public ViewParent invalidateChildInParent(int[] aLocation, Rect aDirty) {
         ViewParent parent =  super.invalidateChildInParent(aLocation, aDirty);
-        if (parent != null && mRenderer != null) {
+        if (parent != null && (mRenderer != null || mAtlas != null)) {
             // TODO: transform rect and use invalidate(dirty)
             postInvalidate();
         }
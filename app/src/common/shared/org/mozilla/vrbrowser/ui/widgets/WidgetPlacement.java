@@ -39,6 +39,8 @@ public class WidgetPlacement {
     public boolean showPointer = true;
     public boolean firstDraw = false;
     public boolean layer = true;
+    // Small widgets can share the widget atlas surface; it takes precedence over layer.
+    public boolean atlas = false;
 
     public WidgetPlacement clone() {
         WidgetPlacement w = new WidgetPlacement();
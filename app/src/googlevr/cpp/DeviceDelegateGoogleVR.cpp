@@ -6,6 +6,7 @@
 #include "DeviceDelegateGoogleVR.h"
 #include "DeviceUtils.h"
 #include "ElbowModel.h"
+#include "GLStateCache.h"
 #include "GestureDelegate.h"
 
 #include "vrb/CameraEye.h"
@@ -495,13 +496,13 @@ DeviceDelegateGoogleVR::StartFrame() {
       // issue.
       VRB_LOG("Unable to acquire GVR frame. Recreating swap chain.");
       m.CreateSwapChain();
-      VRB_GL_CHECK(glEnable(GL_BLEND));
+      GLStateCache::Instance().Invalidate();
     }
   }
 
   GVR_CHECK(gvr_frame_bind_buffer(m.frame, 0));
-  VRB_GL_CHECK(glClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha()));
-  VRB_GL_CHECK(glEnable(GL_BLEND));
+  GLStateCache::Instance().ClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha());
+  GLStateCache::Instance().Enable(GL_BLEND);
 }
 
 static void
@@ -513,7 +514,7 @@ SetUpViewportAndScissor(const gvr_sizei& framebuf_size,
   int width = static_cast<int>((rect.right - rect.left) * framebuf_size.width);
   int height = static_cast<int>((rect.top - rect.bottom) * framebuf_size.height);
   VRB_GL_CHECK(glViewport(left, bottom, width, height));
-  VRB_GL_CHECK(glEnable(GL_SCISSOR_TEST));
+  GLStateCache::Instance().Enable(GL_SCISSOR_TEST);
   VRB_GL_CHECK(glScissor(left, bottom, width, height));
   VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 }
@@ -538,6 +539,8 @@ DeviceDelegateGoogleVR::EndFrame(const bool aDiscard) {
   m.lastSubmitDiscarded = aDiscard;
   if (!aDiscard) {
     GVR_CHECK(gvr_frame_submit(&m.frame, m.viewportList, m.gvrHeadMatrix));
+    // The GVR distortion renderer runs on this context and leaves its own state behind.
+    GLStateCache::Instance().Invalidate();
   }
 }
 
@@ -548,8 +551,9 @@ DeviceDelegateGoogleVR::InitializeGL() {
   m.maxRenderSize =  GVR_CHECK(gvr_get_maximum_effective_render_target_size(m.gvr));
   m.CreateSwapChain();
   m.InitializeControllers();
-  VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
-  VRB_GL_CHECK(glEnable(GL_CULL_FACE));
+  GLStateCache::Instance().Invalidate();
+  GLStateCache::Instance().Enable(GL_DEPTH_TEST);
+  GLStateCache::Instance().Enable(GL_CULL_FACE);
   m.sixDofHead = GVR_CHECK(gvr_is_feature_supported(m.gvr, GVR_FEATURE_HEAD_POSE_6DOF));
   VRB_LOG("6DoF head tracking supported: %s", (m.sixDofHead ? "True" : "False"));
 }
@@ -0,0 +1,126 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "BrowserEventQueue.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <semaphore.h>
+#include <time.h>
+
+namespace {
+
+// Must be a power of two.
+const uint32_t kCapacity = 1024;
+const uint32_t kMask = kCapacity - 1;
+
+} // namespace
+
+namespace crow {
+
+struct BrowserEventQueue::State {
+  BrowserEvent ring[kCapacity];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  std::atomic<bool> consumerWaiting;
+  std::atomic<uint32_t> dropped;
+  sem_t wakeup;
+
+  State() : head(0), tail(0), consumerWaiting(false), dropped(0) {
+    sem_init(&wakeup, 0, 0);
+  }
+
+  ~State() {
+    sem_destroy(&wakeup);
+  }
+
+  uint32_t Copy(BrowserEvent* aEvents, const uint32_t aMaxEvents) {
+    const uint32_t first = head.load(std::memory_order_relaxed);
+    const uint32_t available = tail.load(std::memory_order_acquire) - first;
+    const uint32_t count = std::min(available, aMaxEvents);
+    for (uint32_t index = 0; index < count; index++) {
+      aEvents[index] = ring[(first + index) & kMask];
+    }
+    head.store(first + count, std::memory_order_release);
+    return count;
+  }
+};
+
+BrowserEventQueuePtr
+BrowserEventQueue::Create() {
+  return std::make_shared<vrb::ConcreteClass<BrowserEventQueue, BrowserEventQueue::State> >();
+}
+
+bool
+BrowserEventQueue::Push(const BrowserEvent& aEvent) {
+  const uint32_t tail = m.tail.load(std::memory_order_relaxed);
+  if (tail - m.head.load(std::memory_order_acquire) >= kCapacity) {
+    if (m.dropped.fetch_add(1, std::memory_order_relaxed) == 0) {
+      VRB_ERROR("Browser event queue is full, dropping events");
+    }
+    return false;
+  }
+  m.ring[tail & kMask] = aEvent;
+  m.tail.store(tail + 1, std::memory_order_seq_cst);
+  // Pairs with the store of consumerWaiting and the fence in Drain: either the
+  // consumer sees the new tail before sleeping or we see that it is waiting.
+  if (m.consumerWaiting.exchange(false, std::memory_order_seq_cst)) {
+    sem_post(&m.wakeup);
+  }
+  return true;
+}
+
+int32_t
+BrowserEventQueue::Drain(BrowserEvent* aEvents, const int32_t aMaxEvents, const int32_t aTimeoutMs) {
+  if (!aEvents || aMaxEvents <= 0) {
+    return 0;
+  }
+  uint32_t count = m.Copy(aEvents, (uint32_t)aMaxEvents);
+  if (count > 0 || aTimeoutMs <= 0) {
+    return (int32_t)count;
+  }
+
+  m.consumerWaiting.store(true, std::memory_order_seq_cst);
+  // The acquire load of tail in Copy could otherwise be ordered before the store
+  // above, letting Push miss the flag while we miss its event.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  count = m.Copy(aEvents, (uint32_t)aMaxEvents);
+  if (count > 0) {
+    m.consumerWaiting.store(false, std::memory_order_relaxed);
+    return (int32_t)count;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += aTimeoutMs / 1000;
+  deadline.tv_nsec += (aTimeoutMs % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  while (sem_timedwait(&m.wakeup, &deadline) != 0 && errno == EINTR) {}
+  m.consumerWaiting.store(false, std::memory_order_relaxed);
+  return (int32_t)m.Copy(aEvents, (uint32_t)aMaxEvents);
+}
+
+void
+BrowserEventQueue::Wake() {
+  if (m.consumerWaiting.exchange(false, std::memory_order_seq_cst)) {
+    sem_post(&m.wakeup);
+  }
+}
+
+uint32_t
+BrowserEventQueue::GetDroppedCount() const {
+  return m.dropped.load(std::memory_order_relaxed);
+}
+
+BrowserEventQueue::BrowserEventQueue(State& aState) : m(aState) {}
+BrowserEventQueue::~BrowserEventQueue() {}
+
+} // namespace crow
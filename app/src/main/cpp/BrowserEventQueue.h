@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_BROWSEREVENTQUEUE_H
+#define VRBROWSER_BROWSEREVENTQUEUE_H
+
+#include "vrb/MacroUtils.h"
+#include <memory>
+#include <stdint.h>
+
+namespace crow {
+
+// Values must match the BrowserEvent* constants in VRBrowserActivity.java.
+enum class BrowserEventType : int32_t {
+  Motion = 0,
+  Scroll = 1,
+  Gesture = 2,
+  Resize = 3,
+  Back = 4
+};
+
+// Plain data copied byte for byte into the direct ByteBuffer read by Java.
+struct BrowserEvent {
+  int32_t type;
+  int32_t handle;
+  int32_t controller;
+  int32_t pressed;
+  float values[2];
+};
+const int32_t kBrowserEventSize = sizeof(BrowserEvent);
+
+class BrowserEventQueue;
+typedef std::shared_ptr<BrowserEventQueue> BrowserEventQueuePtr;
+
+// Single producer, single consumer ring used to hand events from the render
+// thread to the Java event thread. Push never blocks or allocates; when the ring
+// is full the event is dropped and counted.
+class BrowserEventQueue {
+public:
+  static BrowserEventQueuePtr Create();
+  // Render thread only.
+  bool Push(const BrowserEvent& aEvent);
+  // Consumer thread only. Waits up to aTimeoutMs for at least one event and
+  // copies up to aMaxEvents into aEvents. Returns the number of events copied.
+  int32_t Drain(BrowserEvent* aEvents, const int32_t aMaxEvents, const int32_t aTimeoutMs);
+  // Wakes a consumer blocked in Drain.
+  void Wake();
+  uint32_t GetDroppedCount() const;
+protected:
+  struct State;
+  BrowserEventQueue(State& aState);
+  ~BrowserEventQueue();
+private:
+  State& m;
+  BrowserEventQueue() = delete;
+  VRB_NO_DEFAULTS(BrowserEventQueue)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_BROWSEREVENTQUEUE_H
@@ -7,16 +7,22 @@
 #include "Controller.h"
 #include "ControllerContainer.h"
 #include "FadeAnimation.h"
+#include "FrameProfiler.h"
+#include "FrameScheduler.h"
+#include "GLStateCache.h"
 #include "Device.h"
 #include "DeviceDelegate.h"
 #include "ExternalBlitter.h"
 #include "ExternalVR.h"
 #include "GeckoSurfaceTexture.h"
+#include "HeadPoseChannel.h"
+#include "ImmersiveTelemetry.h"
 #include "LoadingAnimation.h"
 #include "Skybox.h"
 #include "SplashAnimation.h"
 #include "Pointer.h"
 #include "Widget.h"
+#include "WidgetAtlas.h"
 #include "WidgetPlacement.h"
 #include "Quad.h"
 #include "VRBrowser.h"
@@ -52,6 +58,8 @@
 #include <array>
 #include <functional>
 #include <fstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #define ASSERT_ON_RENDER_THREAD(X)                                          \
   if (m.context && !m.context->IsOnRenderThread()) {                        \
@@ -74,6 +82,18 @@ static const int GestureSwipeRight = 1;
 static const float kScrollFactor = 20.0f; // Just picked what fell right.
 static const float kWorldDPIRatio = 2.0f/720.0f;
 static const double kHoverRate = 1.0 / 10.0;
+// 2D layers submitted by WebVR content are shown this far in front of the viewer.
+static const float kContentLayerDistance = 1.5f;
+static const float kContentLayerWidth = 1.6f;
+// Yaw between content layers that appear together, so they do not cover each other.
+static const float kContentLayerYawStep = 0.6f;
+static const int32_t kWidgetAtlasWidth = 1024;
+static const int32_t kWidgetAtlasHeight = 1024;
+static const int32_t kSkyboxLayerSize = 1024;
+static const std::string kEmptySkyboxPath = "cubemap/void";
+// Head movement below these is not audible, so the audio engine is not sent the pose.
+static const float kHeadPoseMinDegrees = 0.5f;
+static const float kHeadPoseMinMeters = 0.005f;
 
 #if SPACE_THEME == 1
   static const std::string CubemapDay = "cubemap/space";
@@ -129,9 +149,27 @@ SurfaceObserver::SurfaceTextureCreationError(const std::string& aName, const std
 
 namespace crow {
 
+// World space bounding sphere of a widget's hit area, used to reject controller rays
+// before running the exact quad intersection.
+struct HitBounds {
+  WidgetPtr widget;
+  vrb::Vector center;
+  float radius;
+};
+
 struct BrowserWorld::State {
   BrowserWorldWeakPtr self;
   std::vector<WidgetPtr> widgets;
+  std::unordered_map<int32_t, WidgetPtr> widgetsByHandle;
+  std::unordered_map<std::string, WidgetPtr> widgetsBySurfaceName;
+  WidgetAtlasPtr widgetAtlas;
+  std::unordered_map<const vrb::Node*, float> depthKeys;
+  std::unordered_map<int32_t, std::vector<int32_t>> layoutChildren;
+  std::unordered_set<int32_t> dirtyLayout;
+  std::unordered_set<int32_t> layoutVisited;
+  std::vector<HitBounds> hitBounds;
+  bool hitBoundsDirty;
+  vrb::Matrix hitBoundsReorient;
   SurfaceObserverPtr surfaceObserver;
   DeviceDelegatePtr device;
   bool paused;
@@ -148,6 +186,9 @@ struct BrowserWorld::State {
   ControllerContainerPtr controllers;
   CullVisitorPtr cullVisitor;
   DrawableListPtr drawList;
+  DrawableListPtr opaqueList;
+  DrawableListPtr controllerList;
+  DrawableListPtr transparentList;
   CameraPtr leftCamera;
   CameraPtr rightCamera;
   float nearClip;
@@ -160,15 +201,44 @@ struct BrowserWorld::State {
   bool windowsInitialized;
   SkyboxPtr skybox;
   FadeAnimationPtr fadeAnimation;
-  uint32_t loaderDelay;
   bool exitImmersiveRequested;
   WidgetPtr resizingWidget;
   LoadingAnimationPtr loadingAnimation;
   SplashAnimationPtr splashAnimation;
   VRVideoPtr vrVideo;
+  uint32_t videoRequest;
+  // A video shown while its creation is still deferred, kept so InitializeGL can
+  // queue it again if ShutdownGL drops the task.
+  WidgetPtr videoWidget;
+  VRVideo::VRVideoProjection videoProjection;
+  bool videoPending;
+  // Skybox creation is spread over several scheduler frames, see LoadSkyboxStage.
+  std::string skyboxPath;
+  std::string skyboxExtension;
+  bool skyboxPending;
+  bool skyboxQueued;
+  bool skyboxLayerCreated;
+  VRLayerCubePtr skyboxLayer;
+  FrameProfilerPtr profiler;
+  FrameSchedulerPtr scheduler;
+  HeadPoseChannelPtr headPose;
+  struct ContentLayerSlot {
+    VRLayerQuadPtr layer;
+    int32_t surfaceHandle;
+    uint64_t frameId;
+    vrb::Matrix transform;
+    bool placed;
+    ContentLayerSlot() : surfaceHandle(0), frameId(0), transform(vrb::Matrix::Identity()), placed(false) {}
+  };
+  std::vector<ExternalVR::ContentLayer> contentLayerInfo;
+  std::vector<ContentLayerSlot> contentLayers;
+  bool externalProjectionLayer;
 
   State() : paused(true), glInitialized(false), modelsLoaded(false), env(nullptr), nearClip(0.1f),
-            farClip(300.0f), activity(nullptr), windowsInitialized(false), exitImmersiveRequested(false), loaderDelay(0) {
+            farClip(300.0f), activity(nullptr), windowsInitialized(false), exitImmersiveRequested(false), videoRequest(0),
+            videoProjection(VRVideo::VRVideoProjection::VIDEO_PROJECTION_360), videoPending(false),
+            skyboxPending(false), skyboxQueued(false), skyboxLayerCreated(false),
+            externalProjectionLayer(false), hitBoundsDirty(true) {
     context = RenderContext::Create();
     create = context->GetRenderThreadCreationContext();
     loader = ModelLoaderAndroid::Create(context);
@@ -183,19 +253,40 @@ struct BrowserWorld::State {
     rootController->AddLight(light);
     cullVisitor = CullVisitor::Create(create);
     drawList = DrawableList::Create(create);
+    opaqueList = DrawableList::Create(create);
+    controllerList = DrawableList::Create(create);
+    transparentList = DrawableList::Create(create);
     controllers = ControllerContainer::Create(create, rootTransparent);
     externalVR = ExternalVR::Create();
     blitter = ExternalBlitter::Create(create);
     fadeAnimation = FadeAnimation::Create(create);
     loadingAnimation = LoadingAnimation::Create(create);
     splashAnimation = SplashAnimation::Create(create);
+    profiler = FrameProfiler::Create();
+    scheduler = FrameScheduler::Create();
+    headPose = HeadPoseChannel::Create();
+    headPose->SetThresholds(kHeadPoseMinDegrees, kHeadPoseMinMeters);
   }
 
   void CheckBackButton();
   bool CheckExitImmersive();
-  void UpdateControllers(bool& aRelayoutWidgets);
+  void ReleaseContentLayers(const size_t aKeep);
+  void UpdateHitBounds();
+  void UpdateControllers();
   WidgetPtr GetWidget(int32_t aHandle) const;
-  WidgetPtr FindWidget(const std::function<bool(const WidgetPtr&)>& aCondition) const;
+  WidgetPtr GetWidgetBySurfaceName(const std::string& aName) const;
+  jobject LookupAtlasSurface() const;
+  void DispatchAtlasSlot(const WidgetPtr& aWidget, jobject aSurface) const;
+  void SetLayoutParent(const int32_t aHandle, const int32_t aOldParent, const int32_t aNewParent);
+  void ApplyLayout(const WidgetPtr& aWidget);
+  void LayoutWidget(const WidgetPtr& aWidget);
+  void LayoutSubtree(const int32_t aHandle);
+  void FlushLayout();
+  void CullScene();
+  void DrawScene(const vrb::Camera& aCamera, const device::Eye aEye);
+  void QueueSkybox();
+  void QueueVRVideo();
+  bool LoadSkyboxStage();
 };
 
 void
@@ -217,13 +308,27 @@ bool
 BrowserWorld::State::CheckExitImmersive() {
   if (exitImmersiveRequested && externalVR->IsPresenting()) {
     externalVR->StopPresenting();
+    device->ClearExternalProjectionLayer();
+    externalProjectionLayer = false;
     blitter->StopPresenting();
+    ReleaseContentLayers(0);
     exitImmersiveRequested = false;
     return true;
   }
   return false;
 }
 
+// Deletes the compositor layers of all but the first aKeep content layers.
+void
+BrowserWorld::State::ReleaseContentLayers(const size_t aKeep) {
+  while (contentLayers.size() > aKeep) {
+    if (device && contentLayers.back().layer) {
+      device->DeleteLayer(contentLayers.back().layer);
+    }
+    contentLayers.pop_back();
+  }
+}
+
 static bool
 OutOfDeadZone(Controller& aController, const float aX, const float aY) {
   if (!aController.inDeadZone) {
@@ -253,8 +358,49 @@ ThrottleHoverEvent(Controller& aController, const double aTimestamp, const bool
   return false;
 }
 
+static bool
+RayMissesBounds(const HitBounds& aBounds, const vrb::Vector& aStart, const vrb::Vector& aDirection, const float aMaxDistance) {
+  const vrb::Vector toCenter = aBounds.center - aStart;
+  const float centerDistance = toCenter.Magnitude();
+  if ((centerDistance - aBounds.radius) > aMaxDistance) {
+    return true;
+  }
+  const float length = aDirection.Magnitude();
+  if (length <= 0.0f) {
+    return true;
+  }
+  const float along = toCenter.Dot(aDirection) / length;
+  return ((centerDistance * centerDistance) - (along * along)) > (aBounds.radius * aBounds.radius);
+}
+
+// Bounds only change when a widget is added, removed, laid out or the world is reoriented.
 void
-BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
+BrowserWorld::State::UpdateHitBounds() {
+  vrb::Matrix reorient = rootOpaque->GetTransform();
+  if (!hitBoundsDirty && memcmp(reorient.Data(), hitBoundsReorient.Data(), sizeof(float) * 16) == 0) {
+    return;
+  }
+  hitBoundsDirty = false;
+  hitBoundsReorient = reorient;
+  hitBounds.clear();
+  for (const WidgetPtr& widget: widgets) {
+    QuadPtr quad = widget->GetQuad();
+    const vrb::Vector& min = quad->GetWorldMin();
+    const vrb::Vector& max = quad->GetWorldMax();
+    // Quad::TestIntersection accepts hits up to 0.1 off the plane.
+    const vrb::Vector extent((max.x() - min.x()) * 0.5f, (max.y() - min.y()) * 0.5f, (max.z() - min.z()) * 0.5f + 0.1f);
+    const vrb::Vector center = (min + max) * 0.5f;
+    HitBounds bounds;
+    bounds.widget = widget;
+    bounds.center = quad->GetTransformNode()->GetWorldTransform().MultiplyPosition(center);
+    bounds.radius = extent.Magnitude();
+    hitBounds.push_back(bounds);
+  }
+}
+
+void
+BrowserWorld::State::UpdateControllers() {
+  UpdateHitBounds();
   for (Controller& controller: controllers->GetControllers()) {
     if (!controller.enabled || (controller.index < 0)) {
       continue;
@@ -272,17 +418,33 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
     WidgetPtr hitWidget;
     float hitDistance = farClip;
     vrb::Vector hitPoint;
-    for (const WidgetPtr& widget: widgets) {
+    auto testWidget = [&](const WidgetPtr& aWidget) {
       vrb::Vector result;
       float distance = 0.0f;
       bool isInWidget = false;
-      if (widget->TestControllerIntersection(start, direction, result, isInWidget, distance)) {
+      if (aWidget->TestControllerIntersection(start, direction, result, isInWidget, distance)) {
         if (isInWidget && (distance < hitDistance)) {
-          hitWidget = widget;
+          hitWidget = aWidget;
           hitDistance = distance;
           hitPoint = result;
         }
       }
+    };
+    // The widget hit last frame is usually hit again, testing it first lets
+    // its distance reject most of the other widgets.
+    WidgetPtr previousHit = controller.widget ? GetWidget(controller.widget) : nullptr;
+    if (previousHit) {
+      testWidget(previousHit);
+    }
+    for (const HitBounds& bounds: hitBounds) {
+      if (bounds.widget == previousHit) {
+        continue;
+      }
+      // The resize handles extend past the quad so resizing widgets are always tested.
+      if (!bounds.widget->IsResizing() && RayMissesBounds(bounds, start, direction, hitDistance)) {
+        continue;
+      }
+      testWidget(bounds.widget);
     }
 
     if ((!hitWidget || !hitWidget->IsResizing()) && resizingWidget) {
@@ -309,12 +471,7 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
 
       resizingWidget = hitWidget;
       if (aResized) {
-        aRelayoutWidgets = true;
-
-        std::shared_ptr<BrowserWorld> world = self.lock();
-        if (world) {
-          world->LayoutWidget(hitWidget->GetHandle());
-        }
+        LayoutWidget(hitWidget);
       }
 
       if (aResizeEnded) {
@@ -392,19 +549,227 @@ BrowserWorld::State::UpdateControllers(bool& aRelayoutWidgets) {
 
 WidgetPtr
 BrowserWorld::State::GetWidget(int32_t aHandle) const {
-  return FindWidget([=](const WidgetPtr& aWidget){
-    return aWidget->GetHandle() == aHandle;
-  });
+  auto iter = widgetsByHandle.find(aHandle);
+  return iter != widgetsByHandle.end() ? iter->second : nullptr;
 }
 
 WidgetPtr
-BrowserWorld::State::FindWidget(const std::function<bool(const WidgetPtr&)>& aCondition) const {
-  for (const WidgetPtr & widget: widgets) {
-    if (aCondition(widget)) {
-      return widget;
+BrowserWorld::State::GetWidgetBySurfaceName(const std::string& aName) const {
+  auto iter = widgetsBySurfaceName.find(aName);
+  return iter != widgetsBySurfaceName.end() ? iter->second : nullptr;
+}
+
+jobject
+BrowserWorld::State::LookupAtlasSurface() const {
+  if (!widgetAtlas || !context) {
+    return nullptr;
+  }
+  return context->GetSurfaceTextureFactory()->LookupSurfaceTexture(widgetAtlas->GetSurfaceTextureName());
+}
+
+void
+BrowserWorld::State::DispatchAtlasSlot(const WidgetPtr& aWidget, jobject aSurface) const {
+  int32_t x = 0, y = 0, width = 0, height = 0;
+  if (!widgetAtlas->GetSlot(aWidget->GetHandle(), x, y, width, height)) {
+    return;
+  }
+  VRBrowser::DispatchCreateAtlasWidget(aWidget->GetHandle(), aSurface, widgetAtlas->GetWidth(),
+                                       widgetAtlas->GetHeight(), x, y, width, height);
+}
+
+void
+BrowserWorld::State::SetLayoutParent(const int32_t aHandle, const int32_t aOldParent, const int32_t aNewParent) {
+  if (aOldParent == aNewParent) {
+    return;
+  }
+  auto iter = layoutChildren.find(aOldParent);
+  if (iter != layoutChildren.end()) {
+    std::vector<int32_t>& children = iter->second;
+    children.erase(std::remove(children.begin(), children.end(), aHandle), children.end());
+    if (children.empty()) {
+      layoutChildren.erase(iter);
     }
   }
-  return {};
+  if (aNewParent >= 0) {
+    layoutChildren[aNewParent].push_back(aHandle);
+  }
+}
+
+void
+BrowserWorld::State::ApplyLayout(const WidgetPtr& aWidget) {
+  WidgetPlacementPtr aPlacement = aWidget->GetPlacement();
+
+  WidgetPtr parent = GetWidget(aPlacement->parentHandle);
+
+  int32_t parentWidth = 0, parentHeight = 0;
+  float parentWorldWith = 0.0f, parentWorldHeight = 0.0f;
+
+  if (parent) {
+    parent->GetSurfaceTextureSize(parentWidth, parentHeight);
+    parent->GetWorldSize(parentWorldWith, parentWorldHeight);
+  }
+
+  float worldWidth = 0.0f, worldHeight = 0.0f;
+  aWidget->GetWorldSize(worldWidth, worldHeight);
+
+  vrb::Matrix transform = vrb::Matrix::Identity();
+  if (aPlacement->rotationAxis.Magnitude() > std::numeric_limits<float>::epsilon()) {
+    transform = vrb::Matrix::Rotation(aPlacement->rotationAxis, aPlacement->rotation);
+  }
+
+  vrb::Vector translation = vrb::Vector(aPlacement->translation.x() * kWorldDPIRatio,
+                                        aPlacement->translation.y() * kWorldDPIRatio,
+                                        aPlacement->translation.z() * kWorldDPIRatio);
+
+  // Widget anchor point
+  translation -= vrb::Vector((aPlacement->anchor.x() - 0.5f) * worldWidth,
+                             (aPlacement->anchor.y() - 0.5f) * worldHeight,
+                             0.0f);
+  // Parent anchor point
+  if (parent) {
+    translation += vrb::Vector(
+      parentWorldWith * aPlacement->parentAnchor.x() - parentWorldWith * 0.5f,
+      parentWorldHeight * aPlacement->parentAnchor.y() - parentWorldHeight * 0.5f,
+      0.0f);
+  }
+
+  transform.TranslateInPlace(translation);
+  aWidget->SetTransform(parent ? parent->GetTransform().PostMultiply(transform) : transform);
+  hitBoundsDirty = true;
+}
+
+// Lay out the widget now and defer its children to the next FlushLayout so a
+// widget that moves many times in a frame only relays out its subtree once.
+void
+BrowserWorld::State::LayoutWidget(const WidgetPtr& aWidget) {
+  ApplyLayout(aWidget);
+  auto iter = layoutChildren.find(aWidget->GetHandle());
+  if (iter != layoutChildren.end()) {
+    dirtyLayout.insert(iter->second.begin(), iter->second.end());
+  }
+}
+
+void
+BrowserWorld::State::LayoutSubtree(const int32_t aHandle) {
+  if (!layoutVisited.insert(aHandle).second) {
+    return;
+  }
+  WidgetPtr widget = GetWidget(aHandle);
+  if (widget) {
+    ApplyLayout(widget);
+  }
+  auto iter = layoutChildren.find(aHandle);
+  if (iter != layoutChildren.end()) {
+    for (const int32_t child: iter->second) {
+      LayoutSubtree(child);
+    }
+  }
+}
+
+void
+BrowserWorld::State::FlushLayout() {
+  if (dirtyLayout.empty()) {
+    return;
+  }
+  layoutVisited.clear();
+  for (const int32_t handle: dirtyLayout) {
+    // Start from the top most dirty ancestor so parents are laid out before their children.
+    int32_t root = handle;
+    int32_t ancestor = handle;
+    for (size_t depth = 0; depth < widgets.size(); depth++) {
+      WidgetPtr widget = GetWidget(ancestor);
+      if (!widget || !widget->GetPlacement()) {
+        break;
+      }
+      ancestor = widget->GetPlacement()->parentHandle;
+      if (dirtyLayout.count(ancestor)) {
+        root = ancestor;
+      }
+    }
+    LayoutSubtree(root);
+  }
+  dirtyLayout.clear();
+}
+
+// Culling does not depend on the eye, so each root is culled once per frame
+// and the resulting draw lists are replayed for every eye.
+void
+BrowserWorld::State::CullScene() {
+  opaqueList->Reset();
+  rootOpaqueParent->Cull(*cullVisitor, *opaqueList);
+  controllerList->Reset();
+  rootController->Cull(*cullVisitor, *controllerList);
+  transparentList->Reset();
+  rootTransparent->Cull(*cullVisitor, *transparentList);
+}
+
+void
+BrowserWorld::State::DrawScene(const vrb::Camera& aCamera, const device::Eye aEye) {
+  opaqueList->Draw(aCamera);
+  if (vrVideo) {
+    vrVideo->SelectEye(aEye);
+    drawList->Reset();
+    vrVideo->GetRoot()->Cull(*cullVisitor, *drawList);
+    drawList->Draw(*leftCamera);
+  }
+  controllerList->Draw(aCamera);
+  GLStateCache::Instance().DepthMask(GL_FALSE);
+  transparentList->Draw(aCamera);
+  GLStateCache::Instance().DepthMask(GL_TRUE);
+}
+
+void
+BrowserWorld::State::QueueSkybox() {
+  if (skyboxQueued) {
+    return;
+  }
+  skyboxQueued = true;
+  scheduler->Queue(TaskPriority::Low, [=]() {
+    return LoadSkyboxStage();
+  });
+}
+
+// Building the projection geometry is deferred so opening a video does not stall
+// the frame. A later Show or Hide request supersedes this one.
+void
+BrowserWorld::State::QueueVRVideo() {
+  const uint32_t request = ++videoRequest;
+  scheduler->Queue(TaskPriority::High, [=]() {
+    if (request == videoRequest) {
+      vrVideo = VRVideo::Create(create, videoWidget, videoProjection, device);
+      videoWidget = nullptr;
+      videoPending = false;
+    }
+    return true;
+  });
+}
+
+// Runs one step per frame: allocate the cube layer, build the skybox, then start loading
+// the requested cubemap. The newest requested path is used when the last step runs.
+bool
+BrowserWorld::State::LoadSkyboxStage() {
+  const bool empty = skyboxPath == kEmptySkyboxPath;
+  if (!skybox && !empty) {
+    if (!skyboxLayerCreated) {
+      const GLenum glFormat = skyboxExtension == ".ktx" ? GL_COMPRESSED_RGB8_ETC2 : GL_RGB8;
+      skyboxLayer = device->CreateLayerCube(kSkyboxLayerSize, kSkyboxLayerSize, glFormat);
+      skyboxLayerCreated = true;
+      return false;
+    }
+    skybox = Skybox::Create(create, skyboxLayer);
+    skyboxLayer = nullptr;
+    rootOpaqueParent->AddNode(skybox->GetRoot());
+    return false;
+  }
+  if (skybox) {
+    skybox->SetVisible(!empty);
+    if (!empty) {
+      skybox->Load(loader, skyboxPath, skyboxExtension);
+    }
+  }
+  skyboxPending = false;
+  skyboxQueued = false;
+  return true;
 }
 
 static BrowserWorldPtr sWorldInstance;
@@ -520,7 +885,7 @@ BrowserWorld::InitializeJava(JNIEnv* aEnv, jobject& aActivity, jobject& aAssetMa
       }
     }
 #if !defined(SNAPDRAGONVR)
-    CreateSkyBox(skyboxPath.c_str(), extension);
+    CreateSkyBox(skyboxPath, extension);
     // Don't load the env model, we are going for skyboxes in v1.0
 //    CreateFloor();
 #endif
@@ -540,10 +905,12 @@ BrowserWorld::InitializeGL() {
   if (m.context) {
     if (!m.glInitialized) {
       m.glInitialized = m.context->InitializeGL();
-      VRB_GL_CHECK(glEnable(GL_BLEND));
-      VRB_GL_CHECK(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-      VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
-      VRB_GL_CHECK(glEnable(GL_CULL_FACE));
+      GLStateCache& glState = GLStateCache::Instance();
+      glState.Invalidate();
+      glState.Enable(GL_BLEND);
+      glState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      glState.Enable(GL_DEPTH_TEST);
+      glState.Enable(GL_CULL_FACE);
       if (!m.glInitialized) {
         return;
       }
@@ -551,7 +918,21 @@ BrowserWorld::InitializeGL() {
         m.splashAnimation->Load(m.context, m.device);
       }
       // delay the m.loader->InitializeGL() call to fix some issues with Daydream activities
-      m.loaderDelay = 3;
+      int32_t loaderDelay = 3;
+      m.scheduler->Queue(TaskPriority::High, [=]() mutable {
+        if (--loaderDelay > 0) {
+          return false;
+        }
+        m.loader->InitializeGL();
+        return true;
+      });
+      // Skybox and video requests dropped by ShutdownGL start over.
+      if (m.skyboxPending) {
+        m.QueueSkybox();
+      }
+      if (m.videoPending) {
+        m.QueueVRVideo();
+      }
       SurfaceTextureFactoryPtr factory = m.context->GetSurfaceTextureFactory();
       for (WidgetPtr& widget: m.widgets) {
         const std::string name = widget->GetSurfaceTextureName();
@@ -560,6 +941,9 @@ BrowserWorld::InitializeGL() {
           SetSurfaceTexture(name, surface);
         }
       }
+      if (jobject surface = m.LookupAtlasSurface()) {
+        SetSurfaceTexture(m.widgetAtlas->GetSurfaceTextureName(), surface);
+      }
     }
   }
 }
@@ -584,6 +968,9 @@ BrowserWorld::ShutdownGL() {
   if (!m.glInitialized) {
     return;
   }
+  // Deferred tasks must not outlive the GL context, InitializeGL queues them again.
+  m.scheduler->Clear();
+  m.skyboxQueued = false;
   if (m.loader) {
     m.loader->ShutdownGL();
   }
@@ -611,16 +998,24 @@ BrowserWorld::Draw() {
       return;
     }
   }
-  if (m.loaderDelay > 0) {
-    m.loaderDelay--;
-    if (m.loaderDelay == 0) {
-      m.loader->InitializeGL();
-    }
+  m.profiler->StartFrame();
+  GLStateCache::Instance().StartFrame();
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::ProcessEvents);
+    m.device->ProcessEvents();
+  }
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::ContextUpdate);
+    m.context->Update();
+  }
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::Tasks);
+    m.scheduler->Run();
+  }
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::PullBrowserState);
+    m.externalVR->PullBrowserState();
   }
-
-  m.device->ProcessEvents();
-  m.context->Update();
-  m.externalVR->PullBrowserState();
 
   m.CheckExitImmersive();
   if (m.splashAnimation) {
@@ -630,20 +1025,27 @@ BrowserWorld::Draw() {
     m.CheckBackButton();
     DrawImmersive();
   } else {
-    bool relayoutWidgets = false;
-    m.UpdateControllers(relayoutWidgets);
-    if (relayoutWidgets) {
-      UpdateVisibleWidgets();
+    // Gecko may stop presenting without an exit request.
+    m.ReleaseContentLayers(0);
+    {
+      FrameProfiler::Scope scope(*m.profiler, FramePhase::UpdateControllers);
+      // Relayouts requested since the last frame are applied before the hit bounds
+      // are rebuilt, so rays never test bounds from the previous layout.
+      m.FlushLayout();
+      m.UpdateControllers();
+      // Widgets resized by the controllers are laid out before they are drawn.
+      m.FlushLayout();
     }
     DrawWorld();
     m.externalVR->PushSystemState();
   }
-  // Update the 3d audio engine with the most recent head rotation.
-  const vrb::Matrix &head = m.device->GetHeadTransform();
-  const vrb::Vector p = head.GetTranslation();
-  const vrb::Quaternion q(head);
-  VRBrowser::HandleAudioPose(q.x(), q.y(), q.z(), q.w(), p.x(), p.y(), p.z());
-
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::AudioPose);
+    // The 3d audio engine samples the most recent head pose at its own rate.
+    const vrb::Matrix &head = m.device->GetHeadTransform();
+    m.headPose->Publish(vrb::Quaternion(head), head.GetTranslation());
+  }
+  m.profiler->EndFrame();
 }
 
 void
@@ -658,7 +1060,7 @@ BrowserWorld::UpdateEnvironment() {
   ASSERT_ON_RENDER_THREAD();
   std::string env = VRBrowser::GetActiveEnvironment();
   VRB_LOG("Setting environment: %s", env.c_str());
-  CreateSkyBox(env.c_str(), "");
+  CreateSkyBox(env, "");
 }
 
 void
@@ -675,9 +1077,16 @@ void
 BrowserWorld::SetSurfaceTexture(const std::string& aName, jobject& aSurface) {
   ASSERT_ON_RENDER_THREAD();
   VRB_LOG("SetSurfaceTexture: %s", aName.c_str());
-  WidgetPtr widget = m.FindWidget([=](const WidgetPtr& aWidget) -> bool {
-    return aName == aWidget->GetSurfaceTextureName();
-  });
+  if (m.widgetAtlas && aName == m.widgetAtlas->GetSurfaceTextureName()) {
+    for (const int32_t handle: m.widgetAtlas->GetHandles()) {
+      WidgetPtr widget = m.GetWidget(handle);
+      if (widget) {
+        m.DispatchAtlasSlot(widget, aSurface);
+      }
+    }
+    return;
+  }
+  WidgetPtr widget = m.GetWidgetBySurfaceName(aName);
   if (widget) {
     int32_t width = 0, height = 0;
     widget->GetSurfaceTextureSize(width, height);
@@ -702,15 +1111,25 @@ BrowserWorld::AddWidget(int32_t aHandle, const WidgetPlacementPtr& aPlacement) {
   int32_t textureHeight = (int32_t)(ceilf(aPlacement->height * aPlacement->density));
 
   WidgetPtr widget;
+  if (aPlacement->atlas) {
+    // Atlas widgets share one surface and need neither their own surface nor a layer.
+    if (!m.widgetAtlas) {
+      m.widgetAtlas = WidgetAtlas::Create(m.context, kWidgetAtlasWidth, kWidgetAtlasHeight);
+    }
+    if (m.widgetAtlas->Allocate(aHandle, textureWidth, textureHeight)) {
+      widget = Widget::Create(m.context, aHandle, m.widgetAtlas, textureWidth, textureHeight, worldWidth);
+    }
+  }
+
   VRLayerQuadPtr layer;
-  if (aPlacement->layer && m.device) {
+  if (!widget && aPlacement->layer && m.device) {
     layer = m.device->CreateLayerQuad(textureWidth, textureHeight,
                                       VRLayerQuad::SurfaceType::AndroidSurface);
   }
 
   if (layer) {
     widget = Widget::Create(m.context, aHandle, layer, worldWidth);
-  } else {
+  } else if (!widget) {
     widget = Widget::Create(m.context, aHandle, textureWidth, textureHeight, worldWidth);
   }
 
@@ -721,7 +1140,15 @@ BrowserWorld::AddWidget(int32_t aHandle, const WidgetPlacementPtr& aPlacement) {
   }
 
   m.widgets.push_back(widget);
+  m.hitBoundsDirty = true;
+  m.widgetsByHandle[aHandle] = widget;
+  m.widgetsBySurfaceName[widget->GetSurfaceTextureName()] = widget;
   UpdateWidget(widget->GetHandle(), aPlacement);
+  if (widget->GetAtlas()) {
+    if (jobject surface = m.LookupAtlasSurface()) {
+      m.DispatchAtlasSlot(widget, surface);
+    }
+  }
 }
 
 void
@@ -735,15 +1162,30 @@ BrowserWorld::UpdateWidget(int32_t aHandle, const WidgetPlacementPtr& aPlacement
 
   int32_t oldWidth = 0;
   int32_t oldHeight = 0;
+  int32_t oldParent = -1;
   if (widget->GetPlacement()) {
       oldWidth = widget->GetPlacement()->width;
       oldHeight = widget->GetPlacement()->height;
+      oldParent = widget->GetPlacement()->parentHandle;
   }
+  m.SetLayoutParent(aHandle, oldParent, aPlacement->parentHandle);
 
   widget->SetPlacement(aPlacement);
   widget->ToggleWidget(aPlacement->visible);
-  widget->SetSurfaceTextureSize((int32_t)(ceilf(aPlacement->width * aPlacement->density)),
-                                (int32_t)(ceilf(aPlacement->height * aPlacement->density)));
+  int32_t oldTextureWidth = 0, oldTextureHeight = 0;
+  widget->GetSurfaceTextureSize(oldTextureWidth, oldTextureHeight);
+  const int32_t textureWidth = (int32_t)(ceilf(aPlacement->width * aPlacement->density));
+  const int32_t textureHeight = (int32_t)(ceilf(aPlacement->height * aPlacement->density));
+  widget->SetSurfaceTextureSize(textureWidth, textureHeight);
+  if (widget->GetAtlas() && (textureWidth != oldTextureWidth || textureHeight != oldTextureHeight)) {
+    // If the atlas is full the widget keeps drawing into its old slot.
+    if (widget->GetAtlas()->Allocate(aHandle, textureWidth, textureHeight)) {
+      widget->UpdateAtlasSlot();
+      if (jobject surface = m.LookupAtlasSurface()) {
+        m.DispatchAtlasSlot(widget, surface);
+      }
+    }
+  }
 
   float worldWidth = 0.0f, worldHeight = 0.0f;
   widget->GetWorldSize(worldWidth, worldHeight);
@@ -757,7 +1199,7 @@ BrowserWorld::UpdateWidget(int32_t aHandle, const WidgetPlacementPtr& aPlacement
     widget->SetWorldWidth(newWorldWidth);
   }
 
-  LayoutWidget(aHandle);
+  m.LayoutWidget(widget);
 }
 
 void
@@ -767,6 +1209,14 @@ BrowserWorld::RemoveWidget(int32_t aHandle) {
   if (widget) {
     widget->ResetFirstDraw();
     widget->GetRoot()->RemoveFromParents();
+    m.depthKeys.erase(widget->GetRoot().get());
+    m.widgetsByHandle.erase(aHandle);
+    m.hitBoundsDirty = true;
+    if (widget->GetPlacement()) {
+      m.SetLayoutParent(aHandle, widget->GetPlacement()->parentHandle, -1);
+    }
+    m.widgetsBySurfaceName.erase(widget->GetSurfaceTextureName());
+    // Keep insertion order, parents are expected to be laid out before their children.
     auto it = std::find(m.widgets.begin(), m.widgets.end(), widget);
     if (it != m.widgets.end()) {
       m.widgets.erase(it);
@@ -774,6 +1224,9 @@ BrowserWorld::RemoveWidget(int32_t aHandle) {
     if (widget->GetLayer()) {
       m.device->DeleteLayer(widget->GetLayer());
     }
+    if (widget->GetAtlas()) {
+      widget->GetAtlas()->Free(aHandle);
+    }
   }
 }
 
@@ -796,57 +1249,12 @@ BrowserWorld::FinishWidgetResize(int32_t aHandle) {
   widget->FinishResize();
 }
 
-void
-BrowserWorld::UpdateVisibleWidgets() {
-  ASSERT_ON_RENDER_THREAD();
-  for (const WidgetPtr& widget: m.widgets) {
-    if (widget->IsVisible() && !widget->IsResizing()) {
-      UpdateWidget(widget->GetHandle(), widget->GetPlacement());
-    }
-  }
-}
-
 void
 BrowserWorld::LayoutWidget(int32_t aHandle) {
   WidgetPtr widget = m.GetWidget(aHandle);
-  WidgetPlacementPtr aPlacement = widget->GetPlacement();
-
-  WidgetPtr parent = m.GetWidget(aPlacement->parentHandle);
-
-  int32_t parentWidth = 0, parentHeight = 0;
-  float parentWorldWith = 0.0f, parentWorldHeight = 0.0f;
-
-  if (parent) {
-    parent->GetSurfaceTextureSize(parentWidth, parentHeight);
-    parent->GetWorldSize(parentWorldWith, parentWorldHeight);
-  }
-
-  float worldWidth = 0.0f, worldHeight = 0.0f;
-  widget->GetWorldSize(worldWidth, worldHeight);
-
-  vrb::Matrix transform = vrb::Matrix::Identity();
-  if (aPlacement->rotationAxis.Magnitude() > std::numeric_limits<float>::epsilon()) {
-    transform = vrb::Matrix::Rotation(aPlacement->rotationAxis, aPlacement->rotation);
-  }
-
-  vrb::Vector translation = vrb::Vector(aPlacement->translation.x() * kWorldDPIRatio,
-                                        aPlacement->translation.y() * kWorldDPIRatio,
-                                        aPlacement->translation.z() * kWorldDPIRatio);
-
-  // Widget anchor point
-  translation -= vrb::Vector((aPlacement->anchor.x() - 0.5f) * worldWidth,
-                             (aPlacement->anchor.y() - 0.5f) * worldHeight,
-                             0.0f);
-  // Parent anchor point
-  if (parent) {
-    translation += vrb::Vector(
-      parentWorldWith * aPlacement->parentAnchor.x() - parentWorldWith * 0.5f,
-      parentWorldHeight * aPlacement->parentAnchor.y() - parentWorldHeight * 0.5f,
-      0.0f);
+  if (widget) {
+    m.LayoutWidget(widget);
   }
-
-  transform.TranslateInPlace(translation);
-  widget->SetTransform(parent ? parent->GetTransform().PostMultiply(transform) : transform);
 }
 
 void
@@ -871,9 +1279,13 @@ BrowserWorld::ShowVRVideo(const int aWindowHandle, const int aVideoProjection) {
 
   if (m.vrVideo) {
     m.vrVideo->Exit();
+    m.vrVideo = nullptr;
   }
   auto projection = static_cast<VRVideo::VRVideoProjection>(aVideoProjection);
-  m.vrVideo = VRVideo::Create(m.create, widget, projection, m.device);
+  m.videoWidget = widget;
+  m.videoProjection = projection;
+  m.videoPending = true;
+  m.QueueVRVideo();
   if (m.skybox && projection != VRVideo::VRVideoProjection::VIDEO_PROJECTION_3D_SIDE_BY_SIDE) {
     m.skybox->SetVisible(false);
   }
@@ -884,6 +1296,9 @@ BrowserWorld::ShowVRVideo(const int aWindowHandle, const int aVideoProjection) {
 
 void
 BrowserWorld::HideVRVideo() {
+  m.videoRequest++;
+  m.videoWidget = nullptr;
+  m.videoPending = false;
   if (m.vrVideo) {
     m.vrVideo->Exit();
   }
@@ -911,6 +1326,21 @@ BrowserWorld::ResetUIYaw() {
   m.device->SetReorientTransform(matrix);
 }
 
+const FrameProfilerPtr&
+BrowserWorld::GetFrameProfiler() const {
+  return m.profiler;
+}
+
+const HeadPoseChannelPtr&
+BrowserWorld::GetHeadPoseChannel() const {
+  return m.headPose;
+}
+
+const ImmersiveTelemetryPtr&
+BrowserWorld::GetImmersiveTelemetry() const {
+  return m.externalVR->GetTelemetry();
+}
+
 JNIEnv*
 BrowserWorld::GetJNIEnv() const {
   ASSERT_ON_RENDER_THREAD(nullptr);
@@ -942,61 +1372,33 @@ BrowserWorld::DrawWorld() {
   if (m.skybox) {
     m.skybox->SetTransform(vrb::Matrix::Translation(headPosition));
   }
-  m.rootTransparent->SortNodes([=](const NodePtr& a, const NodePtr& b) {
-    float da = DistanceToPlane(a, headPosition, headDirection);
-    float db = DistanceToPlane(b, headPosition, headDirection);
-    if (da < 0.0f) {
-      da = std::numeric_limits<float>::max();
-    }
-    if (db < 0.0f) {
-      db = std::numeric_limits<float>::max();
-    }
-    return da < db;
-  });
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::TransparentSort);
+    SortTransparentNodes(headPosition, headDirection);
+  }
   m.device->StartFrame();
   m.rootOpaque->SetTransform(m.device->GetReorientTransform());
   m.rootTransparent->SetTransform(m.device->GetReorientTransform());
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::Cull);
+    m.CullScene();
+  }
 
-  m.device->BindEye(device::Eye::Left);
-  m.drawList->Reset();
-  m.rootOpaqueParent->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*m.leftCamera);
-  if (m.vrVideo) {
-    m.vrVideo->SelectEye(device::Eye::Left);
-    m.drawList->Reset();
-    m.vrVideo->GetRoot()->Cull(*m.cullVisitor, *m.drawList);
-    m.drawList->Draw(*m.leftCamera);
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::DrawLeftEye);
+    m.device->BindEye(device::Eye::Left);
+    m.DrawScene(*m.leftCamera, device::Eye::Left);
   }
-  m.drawList->Reset();
-  m.rootController->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*m.leftCamera);
-  VRB_GL_CHECK(glDepthMask(GL_FALSE));
-  m.drawList->Reset();
-  m.rootTransparent->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*m.leftCamera);
-  VRB_GL_CHECK(glDepthMask(GL_TRUE));
   // When running the noapi flavor, we only want to render one eye.
 #if !defined(VRBROWSER_NO_VR_API)
-  m.device->BindEye(device::Eye::Right);
-  m.drawList->Reset();
-  m.rootOpaqueParent->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*m.rightCamera);
-  if (m.vrVideo) {
-    m.vrVideo->SelectEye(device::Eye::Right);
-    m.drawList->Reset();
-    m.vrVideo->GetRoot()->Cull(*m.cullVisitor, *m.drawList);
-    m.drawList->Draw(*m.leftCamera);
+  {
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::DrawRightEye);
+    m.device->BindEye(device::Eye::Right);
+    m.DrawScene(*m.rightCamera, device::Eye::Right);
   }
-  m.drawList->Reset();
-  m.rootController->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*m.rightCamera);
-  VRB_GL_CHECK(glDepthMask(GL_FALSE));
-  m.drawList->Reset();
-  m.rootTransparent->Cull(*m.cullVisitor, *m.drawList);
-  m.drawList->Draw(*m.rightCamera);
-  VRB_GL_CHECK(glDepthMask(GL_TRUE));
 #endif // !defined(VRBROWSER_NO_VR_API)
 
+  FrameProfiler::Scope scope(*m.profiler, FramePhase::EndFrame);
   m.device->EndFrame(false);
 }
 
@@ -1006,26 +1408,68 @@ BrowserWorld::DrawImmersive() {
   m.device->SetRenderMode(device::RenderMode::Immersive);
 
   m.device->StartFrame();
-  VRB_GL_CHECK(glDepthMask(GL_FALSE));
-  m.externalVR->PushFramePoses(m.device->GetHeadTransform(), m.controllers->GetControllers());
+  GLStateCache::Instance().DepthMask(GL_FALSE);
+  const double displayTime = m.device->GetPredictedDisplayTime();
+  m.externalVR->PushFramePoses(m.device->GetHeadTransform(), m.controllers->GetControllers(), displayTime);
   int32_t surfaceHandle = 0;
   device::EyeRect leftEye, rightEye;
-  bool aDiscardFrame = !m.externalVR->WaitFrameResult();
+  // Without a new frame the last one is reprojected, so a slow page never costs us a vsync.
+  bool aDiscardFrame = !m.externalVR->WaitFrameResult(displayTime);
   m.externalVR->GetFrameResult(surfaceHandle, leftEye, rightEye);
   ExternalVR::VRState state = m.externalVR->GetVRState();
   if (state == ExternalVR::VRState::Rendering) {
+    const vrb::Matrix& head = m.device->GetHeadTransform();
+    bool draw = true;
     if (!aDiscardFrame) {
-      m.blitter->StartFrame(surfaceHandle, leftEye, rightEye);
-      m.device->BindEye(device::Eye::Left);
-      m.blitter->Draw(device::Eye::Left);
+      // Reprojection starts from the pose content rendered the frame with.
+      vrb::Matrix frameHead = head;
+      m.externalVR->GetFrameHeadTransform(frameHead);
+      m.blitter->StartFrame(surfaceHandle, leftEye, rightEye, frameHead);
+      // Let the device compositor sample the frame directly when it can, so it does not
+      // have to be copied into the eye buffers.
+      const GLuint texture = m.blitter->GetFrameTexture();
+      m.externalProjectionLayer = texture && m.device->SetExternalProjectionLayer(texture, leftEye, rightEye);
+    } else {
+      // Content is late, show its last frame rotated to the current head pose. A device
+      // compositor reprojects the external layer itself from the pose it was set with.
+      draw = m.blitter->StartReprojectedFrame(head);
+    }
+    if (!draw && m.externalProjectionLayer) {
+      m.device->ClearExternalProjectionLayer();
+      m.externalProjectionLayer = false;
+    }
+    if (draw && !m.externalProjectionLayer) {
+      const int64_t blitStart = FrameProfiler::Now();
+      const vrb::Matrix leftPerspective = m.device->GetCamera(device::Eye::Left)->GetPerspective();
+      const vrb::Matrix rightPerspective = m.device->GetCamera(device::Eye::Right)->GetPerspective();
+      if (m.device->IsMultiviewSupported() && m.blitter->IsMultiviewSupported()) {
+        // Both eyes in one pass into the layered eye buffer.
+        FrameProfiler::Scope scope(*m.profiler, FramePhase::DrawLeftEye);
+        m.device->BindMultiviewEyes();
+        m.blitter->DrawMultiview(leftPerspective, rightPerspective);
+      } else {
+        {
+          FrameProfiler::Scope scope(*m.profiler, FramePhase::DrawLeftEye);
+          m.device->BindEye(device::Eye::Left);
+          m.blitter->Draw(device::Eye::Left, leftPerspective);
+        }
 #if !defined(VRBROWSER_NO_VR_API)
-      m.device->BindEye(device::Eye::Right);
-      m.blitter->Draw(device::Eye::Right);
+        FrameProfiler::Scope scope(*m.profiler, FramePhase::DrawRightEye);
+        m.device->BindEye(device::Eye::Right);
+        m.blitter->Draw(device::Eye::Right, rightPerspective);
 #endif // !defined(VRBROWSER_NO_VR_API)
+      }
+      m.externalVR->RecordBlitTime(double(FrameProfiler::Now() - blitStart) * 1e-9);
     }
-    m.device->EndFrame(aDiscardFrame);
-    m.blitter->EndFrame();
+    FrameProfiler::Scope scope(*m.profiler, FramePhase::EndFrame);
+    DrawContentLayers();
+    m.device->EndFrame(!draw);
+    m.blitter->EndFrame(m.externalProjectionLayer);
   } else {
+    if (m.externalProjectionLayer) {
+      m.device->ClearExternalProjectionLayer();
+      m.externalProjectionLayer = false;
+    }
     if (surfaceHandle != 0) {
       m.blitter->CancelFrame(surfaceHandle);
     }
@@ -1034,9 +1478,79 @@ BrowserWorld::DrawImmersive() {
   }
 }
 
+// Each 2D content layer is copied once into its own compositor quad layer instead of
+// being drawn into both eye buffers. Devices without quad layers do not show them.
+void
+BrowserWorld::DrawContentLayers() {
+  m.externalVR->GetContentLayers(m.contentLayerInfo);
+  m.ReleaseContentLayers(m.contentLayerInfo.size());
+  if (m.contentLayerInfo.empty()) {
+    return;
+  }
+  int32_t width = 0, height = 0;
+  m.externalVR->GetEyeResolution(width, height);
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  while (m.contentLayers.size() < m.contentLayerInfo.size()) {
+    VRLayerQuadPtr layer = m.device->CreateLayerQuad(width, height, VRLayerQuad::SurfaceType::FBO);
+    if (!layer) {
+      return;
+    }
+    // Layers only draw once the device reports their surface as created.
+    layer->SetSurfaceChangedDelegate([](const VRLayer& aLayer, VRLayer::SurfaceChange aChange, const std::function<void()>& aCallback) {
+      if (aCallback) {
+        aCallback();
+      }
+    });
+    layer->SetWorldSize(kContentLayerWidth, kContentLayerWidth * (float)height / (float)width);
+    layer->SetDrawInFront(true);
+    layer->SetPriority((int32_t)m.contentLayers.size());
+    State::ContentLayerSlot slot;
+    slot.layer = layer;
+    m.contentLayers.push_back(slot);
+  }
+
+  const vrb::Matrix& head = m.device->GetHeadTransform();
+  for (size_t index = 0; index < m.contentLayerInfo.size(); index++) {
+    const ExternalVR::ContentLayer& info = m.contentLayerInfo[index];
+    State::ContentLayerSlot& slot = m.contentLayers[index];
+    if (slot.surfaceHandle != info.surfaceHandle) {
+      // A different content layer took this slot.
+      slot.surfaceHandle = info.surfaceHandle;
+      slot.frameId = 0;
+      slot.placed = false;
+    }
+    if (!slot.placed) {
+      // World locked in front of where the viewer looks when the layer appears.
+      const vrb::Vector forward = head.MultiplyDirection(vrb::Vector(0.0f, 0.0f, -1.0f));
+      const float yaw = atan2f(-forward.x(), -forward.z()) + kContentLayerYawStep * (float)index;
+      slot.transform = vrb::Matrix::Position(head.GetTranslation())
+          .PostMultiply(vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), yaw))
+          .PostMultiply(vrb::Matrix::Position(vrb::Vector(0.0f, 0.0f, -kContentLayerDistance)));
+      slot.placed = true;
+    }
+    if (!slot.layer->IsInitialized()) {
+      continue;
+    }
+    if (slot.frameId != info.frameId) {
+      slot.layer->Bind();
+      VRB_GL_CHECK(glViewport(0, 0, width, height));
+      m.blitter->DrawContentLayer(info.surfaceHandle);
+      slot.layer->Unbind();
+      slot.frameId = info.frameId;
+    }
+    for (const device::Eye eye: {device::Eye::Left, device::Eye::Right}) {
+      slot.layer->SetModelTransform(eye, slot.transform);
+      slot.layer->SetModelView(eye, m.device->GetCamera(eye)->GetView().PostMultiply(slot.transform));
+    }
+    slot.layer->RequestDraw();
+  }
+}
+
 void
 BrowserWorld::DrawLoadingAnimation() {
-  VRB_GL_CHECK(glDepthMask(GL_TRUE));
+  GLStateCache::Instance().DepthMask(GL_TRUE);
   m.loadingAnimation->Update();
   m.drawList->Reset();
   m.loadingAnimation->GetRoot()->Cull(*m.cullVisitor, *m.drawList);
@@ -1081,22 +1595,10 @@ BrowserWorld::DrawSplashAnimation() {
 void
 BrowserWorld::CreateSkyBox(const std::string& aBasePath, const std::string& aExtension) {
   ASSERT_ON_RENDER_THREAD();
-  const bool empty = aBasePath == "cubemap/void";
-  const std::string extension = aExtension.empty() ? ".ktx" : aExtension;
-  if (m.skybox && empty) {
-    m.skybox->SetVisible(false);
-    return;
-  } else if (m.skybox) {
-    m.skybox->SetVisible(true);
-    m.skybox->Load(m.loader, aBasePath, extension);
-    return;
-  } else if (!empty) {
-    GLenum glFormat = extension == ".ktx" ? GL_COMPRESSED_RGB8_ETC2 : GL_RGB8;
-    VRLayerCubePtr layer = m.device->CreateLayerCube(1024, 1024, glFormat);
-    m.skybox = Skybox::Create(m.create, layer);
-    m.rootOpaqueParent->AddNode(m.skybox->GetRoot());
-    m.skybox->Load(m.loader, aBasePath, extension);
-  }
+  m.skyboxPath = aBasePath;
+  m.skyboxExtension = aExtension.empty() ? ".ktx" : aExtension;
+  m.skyboxPending = true;
+  m.QueueSkybox();
 }
 
 void
@@ -1125,36 +1627,55 @@ BrowserWorld::CreateFloor() {
   model->SetTransform(transform);
 }
 
-float
-BrowserWorld::DistanceToPlane(const vrb::NodePtr& aNode, const vrb::Vector& aPosition, const vrb::Vector& aDirection) const {
-  WidgetPtr target;
-  bool pointer = false;
-  for (const auto & widget: m.widgets) {
-    if (widget->GetRoot() == aNode) {
-      target = widget;
-      break;
-    }
+void
+BrowserWorld::SortTransparentNodes(const vrb::Vector& aPosition, const vrb::Vector& aDirection) {
+  // Compute a single depth key per node each frame so the sort comparator is a plain lookup.
+  // Nodes behind the head or without a widget sort last.
+  const float kFarKey = std::numeric_limits<float>::max();
+  for (const WidgetPtr& widget: m.widgets) {
+    const float distance = widget->IsVisible() ? DistanceToPlane(widget, aPosition, aDirection) : -1.0f;
+    m.depthKeys[widget->GetRoot().get()] = distance < 0.0f ? kFarKey : distance;
   }
-  if (!target) {
-    for (Controller& controller: m.controllers->GetControllers()) {
-      if (controller.pointer && controller.pointer->GetRoot() == aNode) {
-        target = controller.pointer->GetHitWidget();
-        pointer = true;
-        break;
-      }
+  for (Controller& controller: m.controllers->GetControllers()) {
+    if (!controller.pointer) {
+      continue;
     }
+    float key = kFarKey;
+    const WidgetPtr& target = controller.pointer->GetHitWidget();
+    if (target) {
+      auto iter = m.depthKeys.find(target->GetRoot().get());
+      // Draw the pointer just in front of the widget it is hitting.
+      const float distance = iter != m.depthKeys.end() && iter->second < kFarKey ? iter->second - 0.001f : -1.0f;
+      key = distance < 0.0f ? kFarKey : distance;
+    }
+    m.depthKeys[controller.pointer->GetRoot().get()] = key;
+  }
+
+  auto depthKey = [&](const vrb::NodePtr& aNode) -> float {
+    auto iter = m.depthKeys.find(aNode.get());
+    return iter != m.depthKeys.end() ? iter->second : kFarKey;
+  };
+
+  // The order seldom changes between frames, so only sort when it is out of order.
+  float previous = -1.0f;
+  for (int32_t index = 0; index < m.rootTransparent->GetNodeCount(); index++) {
+    const float current = depthKey(m.rootTransparent->GetNode(index));
+    if (current < previous) {
+      m.rootTransparent->SortNodes([&](const NodePtr& a, const NodePtr& b) {
+        return depthKey(a) < depthKey(b);
+      });
+      return;
+    }
+    previous = current;
   }
+}
 
-  if (!target) {
-    return -1.0f;
-  }
+float
+BrowserWorld::DistanceToPlane(const WidgetPtr& aWidget, const vrb::Vector& aPosition, const vrb::Vector& aDirection) const {
   vrb::Vector result;
   bool inside = false;
   float distance = -1.0f;
-  target->GetQuad()->TestIntersection(aPosition, aDirection, result, false, inside, distance);
-  if (pointer) {
-    distance-= 0.001f;
-  }
+  aWidget->GetQuad()->TestIntersection(aPosition, aDirection, result, false, inside, distance);
   return distance;
 }
 
@@ -1260,6 +1781,122 @@ JNI_METHOD(void, resetUIYawNative)
   crow::BrowserWorld::Instance().ResetUIYaw();
 }
 
+JNI_METHOD(jfloatArray, getFrameTimingsNative)
+(JNIEnv* aEnv, jobject) {
+  crow::FrameProfiler::PhaseStats stats[crow::FramePhaseCount];
+  crow::BrowserWorld::Instance().GetFrameProfiler()->GetStats(stats);
+  const jsize count = crow::FramePhaseCount * 3;
+  jfloat values[count];
+  for (int32_t phase = 0; phase < crow::FramePhaseCount; phase++) {
+    values[phase * 3] = stats[phase].min;
+    values[phase * 3 + 1] = stats[phase].average;
+    values[phase * 3 + 2] = stats[phase].p99;
+  }
+  jfloatArray result = aEnv->NewFloatArray(count);
+  if (result) {
+    aEnv->SetFloatArrayRegion(result, 0, count, values);
+  }
+  return result;
+}
+
+JNI_METHOD(jboolean, dumpFrameTimingsNative)
+(JNIEnv* aEnv, jobject, jstring aPath) {
+  const char *nativeString = aEnv->GetStringUTFChars(aPath, 0);
+  std::string path = nativeString;
+  aEnv->ReleaseStringUTFChars(aPath, nativeString);
+  return (jboolean) crow::BrowserWorld::Instance().GetFrameProfiler()->DumpToFile(path);
+}
+
+JNI_METHOD(jfloatArray, getImmersiveTelemetryNative)
+(JNIEnv* aEnv, jobject) {
+  const crow::ImmersiveTelemetryPtr& telemetry = crow::BrowserWorld::Instance().GetImmersiveTelemetry();
+  const jsize count = crow::TelemetryMetricCount * 5 + 2;
+  jfloat values[count];
+  for (int32_t metric = 0; metric < crow::TelemetryMetricCount; metric++) {
+    const crow::ImmersiveTelemetry::Summary summary = telemetry->GetSummary(static_cast<crow::TelemetryMetric>(metric));
+    values[metric * 5] = summary.count;
+    values[metric * 5 + 1] = summary.p50;
+    values[metric * 5 + 2] = summary.p90;
+    values[metric * 5 + 3] = summary.p99;
+    values[metric * 5 + 4] = summary.max;
+  }
+  values[count - 2] = telemetry->GetSkippedFrames();
+  values[count - 1] = telemetry->GetRepeatedFrames();
+  jfloatArray result = aEnv->NewFloatArray(count);
+  if (result) {
+    aEnv->SetFloatArrayRegion(result, 0, count, values);
+  }
+  return result;
+}
+
+JNI_METHOD(jlongArray, getImmersiveHistogramNative)
+(JNIEnv* aEnv, jobject, jint aMetric) {
+  if (aMetric < 0 || aMetric >= crow::TelemetryMetricCount) {
+    return nullptr;
+  }
+  uint64_t counts[crow::ImmersiveTelemetry::kBucketCount];
+  crow::BrowserWorld::Instance().GetImmersiveTelemetry()->GetHistogram(static_cast<crow::TelemetryMetric>(aMetric), counts);
+  // Pairs of bucket lower bound and count, for non empty buckets only.
+  jlong values[crow::ImmersiveTelemetry::kBucketCount * 2];
+  jsize count = 0;
+  for (int32_t bucket = 0; bucket < crow::ImmersiveTelemetry::kBucketCount; bucket++) {
+    if (counts[bucket] > 0) {
+      values[count++] = crow::ImmersiveTelemetry::BucketLowerBound(bucket);
+      values[count++] = (jlong) counts[bucket];
+    }
+  }
+  jlongArray result = aEnv->NewLongArray(count);
+  if (result) {
+    aEnv->SetLongArrayRegion(result, 0, count, values);
+  }
+  return result;
+}
+
+JNI_METHOD(jboolean, dumpImmersiveTelemetryNative)
+(JNIEnv* aEnv, jobject, jstring aPath) {
+  const char *nativeString = aEnv->GetStringUTFChars(aPath, 0);
+  std::string path = nativeString;
+  aEnv->ReleaseStringUTFChars(aPath, nativeString);
+  return (jboolean) crow::BrowserWorld::Instance().GetImmersiveTelemetry()->DumpToFile(path);
+}
+
+JNI_METHOD(jlongArray, getGLStateCountersNative)
+(JNIEnv* aEnv, jobject) {
+  const crow::GLStateCache::Counters frame = crow::GLStateCache::Instance().GetFrameCounters();
+  const crow::GLStateCache::Counters total = crow::GLStateCache::Instance().GetTotalCounters();
+  const jsize count = 4;
+  const jlong values[count] = {(jlong)frame.issued, (jlong)frame.elided, (jlong)total.issued, (jlong)total.elided};
+  jlongArray result = aEnv->NewLongArray(count);
+  if (result) {
+    aEnv->SetLongArrayRegion(result, 0, count, values);
+  }
+  return result;
+}
+
+JNI_METHOD(jint, readHeadPoseNative)
+(JNIEnv* aEnv, jobject, jfloatArray aPose) {
+  jfloat values[crow::HeadPoseChannel::kValueCount];
+  const uint32_t sequence = crow::BrowserWorld::Instance().GetHeadPoseChannel()->Read(values);
+  if (sequence > 0) {
+    aEnv->SetFloatArrayRegion(aPose, 0, crow::HeadPoseChannel::kValueCount, values);
+  }
+  return (jint) sequence;
+}
+
+JNI_METHOD(jint, drainBrowserEventsNative)
+(JNIEnv* aEnv, jobject, jobject aBuffer, jint aTimeoutMs) {
+  void* buffer = aEnv->GetDirectBufferAddress(aBuffer);
+  if (!buffer) {
+    return 0;
+  }
+  return crow::VRBrowser::DrainEvents(buffer, aEnv->GetDirectBufferCapacity(aBuffer), aTimeoutMs);
+}
+
+JNI_METHOD(void, wakeBrowserEventsNative)
+(JNIEnv* aEnv, jobject) {
+  crow::VRBrowser::WakeEventConsumer();
+}
+
 JNI_METHOD(void, runCallbackNative)
 (JNIEnv* aEnv, jobject, jlong aCallback) {
   if (aCallback) {
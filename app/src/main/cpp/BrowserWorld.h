@@ -23,6 +23,12 @@ class WidgetPlacement;
 typedef std::shared_ptr<WidgetPlacement> WidgetPlacementPtr;
 class Widget;
 typedef std::shared_ptr<Widget> WidgetPtr;
+class FrameProfiler;
+typedef std::shared_ptr<FrameProfiler> FrameProfilerPtr;
+class HeadPoseChannel;
+typedef std::shared_ptr<HeadPoseChannel> HeadPoseChannelPtr;
+class ImmersiveTelemetry;
+typedef std::shared_ptr<ImmersiveTelemetry> ImmersiveTelemetryPtr;
 
 class BrowserWorld {
 public:
@@ -47,7 +53,6 @@ public:
   void RemoveWidget(int32_t aHandle);
   void StartWidgetResize(int32_t aHandle);
   void FinishWidgetResize(int32_t aHandle);
-  void UpdateVisibleWidgets();
   void LayoutWidget(int32_t aHandle);
   void SetBrightness(const float aBrightness);
   void ExitImmersive();
@@ -55,6 +60,9 @@ public:
   void HideVRVideo();
   void SetControllersVisible(const bool aVisible);
   void ResetUIYaw();
+  const FrameProfilerPtr& GetFrameProfiler() const;
+  const HeadPoseChannelPtr& GetHeadPoseChannel() const;
+  const ImmersiveTelemetryPtr& GetImmersiveTelemetry() const;
   JNIEnv* GetJNIEnv() const;
 protected:
   struct State;
@@ -63,11 +71,13 @@ protected:
   ~BrowserWorld();
   void DrawWorld();
   void DrawImmersive();
+  void DrawContentLayers();
   void DrawLoadingAnimation();
   void DrawSplashAnimation();
   void CreateSkyBox(const std::string& aBasePath, const std::string& aExtension);
   void CreateFloor();
-  float DistanceToPlane(const vrb::NodePtr& aNode, const vrb::Vector& aPosition, const vrb::Vector& aDirection) const;
+  void SortTransparentNodes(const vrb::Vector& aPosition, const vrb::Vector& aDirection);
+  float DistanceToPlane(const WidgetPtr& aWidget, const vrb::Vector& aPosition, const vrb::Vector& aDirection) const;
 private:
   State& m;
   BrowserWorld() = delete;
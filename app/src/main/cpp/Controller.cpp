@@ -52,6 +52,7 @@ Controller::operator=(const Controller& aController) {
   numButtons = aController.numButtons;
   memcpy(immersiveAxes, aController.immersiveAxes, sizeof(immersiveAxes));
   numAxes = aController.numAxes;
+  immersiveDirty = aController.immersiveDirty;
   leftHanded = aController.leftHanded;
   inDeadZone = aController.inDeadZone;
   lastHoverEvent = aController.lastHoverEvent;
@@ -79,6 +80,7 @@ Controller::Reset() {
   numButtons = 0;
   memset(immersiveAxes, 0, sizeof(immersiveAxes));
   numAxes = 0;
+  immersiveDirty = kImmersiveAllDirty;
   leftHanded = false;
   inDeadZone = true;
   lastHoverEvent = 0.0;
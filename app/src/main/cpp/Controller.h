@@ -18,6 +18,12 @@ typedef std::shared_ptr<Pointer> PointerPtr;
 static const int kControllerMaxButtonCount = 4;
 static const int kControllerMaxAxes = 6;
 
+// Parts of the immersive controller state changed since ExternalVR last published them.
+static const uint32_t kImmersiveDescriptorDirty = 1 << 0; // Name, hand, button and axis counts.
+static const uint32_t kImmersiveButtonsDirty = 1 << 1;
+static const uint32_t kImmersiveAxesDirty = 1 << 2;
+static const uint32_t kImmersiveAllDirty = kImmersiveDescriptorDirty | kImmersiveButtonsDirty | kImmersiveAxesDirty;
+
 struct Controller {
   int32_t index;
   bool enabled;
@@ -44,6 +50,7 @@ struct Controller {
   uint32_t numButtons;
   float immersiveAxes[kControllerMaxAxes];
   uint32_t numAxes;
+  uint32_t immersiveDirty;
   bool leftHanded;
   bool inDeadZone;
   double lastHoverEvent;
@@ -169,7 +169,10 @@ ControllerContainer::CreateController(const int32_t aControllerIndex, const int3
   }
   Controller& controller = m.list[aControllerIndex];
   controller.index = aControllerIndex;
-  controller.immersiveName = aImmersiveName;
+  if (controller.immersiveName != aImmersiveName) {
+    controller.immersiveName = aImmersiveName;
+    controller.immersiveDirty |= kImmersiveDescriptorDirty;
+  }
   if (!controller.transform && (aModelIndex >= 0)) {
     m.SetUpModelsGroup(aModelIndex);
     CreationContextPtr create = m.context.lock();
@@ -205,7 +208,10 @@ ControllerContainer::SetEnabled(const int32_t aControllerIndex, const bool aEnab
   if (!m.Contains(aControllerIndex)) {
     return;
   }
-  m.list[aControllerIndex].enabled = aEnabled;
+  if (m.list[aControllerIndex].enabled != aEnabled) {
+    m.list[aControllerIndex].enabled = aEnabled;
+    m.list[aControllerIndex].immersiveDirty |= kImmersiveAllDirty;
+  }
   if (!aEnabled) {
     SetVisible(aControllerIndex, false);
   }
@@ -242,7 +248,10 @@ ControllerContainer::SetButtonCount(const int32_t aControllerIndex, const uint32
   if (!m.Contains(aControllerIndex)) {
     return;
   }
-  m.list[aControllerIndex].numButtons = aNumButtons;
+  if (m.list[aControllerIndex].numButtons != aNumButtons) {
+    m.list[aControllerIndex].numButtons = aNumButtons;
+    m.list[aControllerIndex].immersiveDirty |= kImmersiveDescriptorDirty | kImmersiveButtonsDirty;
+  }
 }
 
 void
@@ -260,23 +269,30 @@ ControllerContainer::SetButtonState(const int32_t aControllerIndex, const Button
   }
 
   if (aImmersiveIndex >= 0) {
+    Controller& controller = m.list[aControllerIndex];
+    const uint64_t pressed = controller.immersivePressedState;
+    const uint64_t touched = controller.immersiveTouchedState;
     if (aPressed) {
-      m.list[aControllerIndex].immersivePressedState |= immersiveButtonMask;
+      controller.immersivePressedState |= immersiveButtonMask;
     } else {
-      m.list[aControllerIndex].immersivePressedState &= ~immersiveButtonMask;
+      controller.immersivePressedState &= ~immersiveButtonMask;
     }
 
     if (aTouched) {
-      m.list[aControllerIndex].immersiveTouchedState |= immersiveButtonMask;
+      controller.immersiveTouchedState |= immersiveButtonMask;
     } else {
-      m.list[aControllerIndex].immersiveTouchedState &= ~immersiveButtonMask;
+      controller.immersiveTouchedState &= ~immersiveButtonMask;
     }
 
     float trigger = aImmersiveTrigger;
     if (trigger < 0.0f) {
       trigger = aPressed ? 1.0f : 0.0f;
     }
-    m.list[aControllerIndex].immersiveTriggerValues[aImmersiveIndex] = trigger;
+    if (pressed != controller.immersivePressedState || touched != controller.immersiveTouchedState ||
+        controller.immersiveTriggerValues[aImmersiveIndex] != trigger) {
+      controller.immersiveTriggerValues[aImmersiveIndex] = trigger;
+      controller.immersiveDirty |= kImmersiveButtonsDirty;
+    }
   }
 }
 
@@ -286,9 +302,16 @@ ControllerContainer::SetAxes(const int32_t aControllerIndex, const float* aData,
     return;
   }
 
-  m.list[aControllerIndex].numAxes = aLength;
+  Controller& controller = m.list[aControllerIndex];
+  if (controller.numAxes != aLength) {
+    controller.numAxes = aLength;
+    controller.immersiveDirty |= kImmersiveDescriptorDirty | kImmersiveAxesDirty;
+  }
   for (int i = 0; i < aLength; ++i) {
-    m.list[aControllerIndex].immersiveAxes[i] = aData[i];
+    if (controller.immersiveAxes[i] != aData[i]) {
+      controller.immersiveAxes[i] = aData[i];
+      controller.immersiveDirty |= kImmersiveAxesDirty;
+    }
   }
 }
 
@@ -298,7 +321,10 @@ ControllerContainer::SetLeftHanded(const int32_t aControllerIndex, const bool aL
     return;
   }
 
-  m.list[aControllerIndex].leftHanded = aLeftHanded;
+  if (m.list[aControllerIndex].leftHanded != aLeftHanded) {
+    m.list[aControllerIndex].leftHanded = aLeftHanded;
+    m.list[aControllerIndex].immersiveDirty |= kImmersiveDescriptorDirty;
+  }
 }
 
 void
@@ -62,6 +62,22 @@ public:
   virtual void StartFrame() = 0;
   virtual void BindEye(const device::Eye aWhich) = 0;
   virtual void EndFrame(bool aDiscard = false) = 0;
+  // Single pass stereo: devices with OVR_multiview2 and a layered eye buffer bind both
+  // eyes at once, the left eye as view 0 and the right eye as view 1. Only valid in
+  // the current render mode; callers fall back to BindEye when it returns false.
+  virtual bool IsMultiviewSupported() const { return false; }
+  virtual void BindMultiviewEyes() {}
+  // Predicted display time of the current frame in CLOCK_MONOTONIC seconds, or zero
+  // if the device can not predict it.
+  virtual double GetPredictedDisplayTime() const { return 0.0; }
+  // Devices whose compositor can sample the GL_TEXTURE_EXTERNAL_OES texture Gecko
+  // renders immersive frames into submit it as the projection layer, with a sub-rect
+  // per eye, instead of the eye buffers. The layer keeps being submitted with the
+  // head pose of the frame it was set in until it is set again or cleared. Returns
+  // false if the device can not do this, in which case the caller blits the frame.
+  virtual bool SetExternalProjectionLayer(const GLuint aTexture, const device::EyeRect& aLeftEye,
+                                          const device::EyeRect& aRightEye) { return false; }
+  virtual void ClearExternalProjectionLayer() {}
   virtual VRLayerQuadPtr CreateLayerQuad(int32_t aWidth,
                                          int32_t aHeight,
                                          VRLayerQuad::SurfaceType aSurfaceType) { return nullptr; }
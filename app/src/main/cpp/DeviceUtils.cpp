@@ -6,6 +6,9 @@
 #include "DeviceUtils.h"
 #include "vrb/Matrix.h"
 #include "vrb/Quaternion.h"
+#include "vrb/gl.h"
+
+#include <cstring>
 
 namespace crow {
 
@@ -48,6 +51,24 @@ DeviceUtils::CalculateReorientationMatrix(const vrb::Matrix& aHeadTransform, con
 
 }
 
+bool
+DeviceUtils::HasGLExtension(const char* aExtension) {
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+  if (!extensions || !aExtension) {
+    return false;
+  }
+  const size_t length = strlen(aExtension);
+  // Match whole names only, GL_OVR_multiview is a prefix of GL_OVR_multiview2.
+  for (const char* match = strstr(extensions, aExtension); match; match = strstr(match + length, aExtension)) {
+    const bool start = match == extensions || match[-1] == ' ';
+    const bool end = match[length] == ' ' || match[length] == '\0';
+    if (start && end) {
+      return true;
+    }
+  }
+  return false;
+}
+
 
 }
 
@@ -14,6 +14,8 @@ namespace crow {
 class DeviceUtils {
 public:
   static vrb::Matrix CalculateReorientationMatrix(const vrb::Matrix& aHeadTransform, const vrb::Vector& aHeightPosition);
+  // Whether the current GL context exposes aExtension, e.g. "GL_OVR_multiview2".
+  static bool HasGLExtension(const char* aExtension);
 private:
   VRB_NO_DEFAULTS(DeviceUtils)
 };
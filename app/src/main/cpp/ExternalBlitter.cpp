@@ -5,22 +5,33 @@
 
 #include "ExternalBlitter.h"
 #include "GeckoSurfaceTexture.h"
+#include "DeviceUtils.h"
+#include "GLStateCache.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/gl.h"
 #include "vrb/GLError.h"
 #include "vrb/Logger.h"
+#include "vrb/Matrix.h"
 #include "vrb/ShaderUtil.h"
+#include "vrb/Vector.h"
 
 #include <map>
 
 namespace {
+// Enough for a WebVR swap chain plus a few 2D content layers. Handles beyond that
+// belong to surfaces Gecko has most likely destroyed.
+const size_t kMaxSurfaces = 8;
+
+// u_reprojection maps a point of the current eye's image plane to the image plane
+// the content frame was rendered with. Interpolating the homogeneous result keeps
+// the mapping exact across the quad.
 static const char* sVertexShader = R"SHADER(
 attribute vec4 a_position;
-attribute vec2 a_uv;
-varying vec2 v_uv;
+uniform mat3 u_reprojection;
+varying vec3 v_position;
 void main(void) {
-  v_uv = a_uv;
+  v_position = u_reprojection * vec3(a_position.xy, 1.0);
   gl_Position = a_position;
 }
 )SHADER";
@@ -30,14 +41,60 @@ static const char* sFragmentShader = R"SHADER(
 precision mediump float;
 
 uniform samplerExternalOES u_texture0;
+uniform vec4 u_uvRect;
 
-varying vec2 v_uv;
+varying vec3 v_position;
 
 void main() {
-  gl_FragColor = texture2D(u_texture0, v_uv);
+  vec2 ndc = v_position.xy / v_position.z;
+  if (v_position.z <= 0.0 || any(greaterThan(abs(ndc), vec2(1.0)))) {
+    gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+    return;
+  }
+  gl_FragColor = texture2D(u_texture0, u_uvRect.xy + (ndc * 0.5 + 0.5) * u_uvRect.zw);
+}
+)SHADER";
+
+// Single pass version for layered eye buffers. Each view picks its eye's reprojection
+// and uv rect with gl_ViewID_OVR; view 0 is the left eye.
+static const char* sMultiviewVertexShader = R"SHADER(#version 300 es
+#extension GL_OVR_multiview2 : require
+layout(num_views = 2) in;
+layout(location = 0) in vec4 a_position;
+uniform mat3 u_reprojection[2];
+uniform vec4 u_uvRect[2];
+out vec3 v_position;
+flat out vec4 v_uvRect;
+void main(void) {
+  v_position = u_reprojection[gl_ViewID_OVR] * vec3(a_position.xy, 1.0);
+  v_uvRect = u_uvRect[gl_ViewID_OVR];
+  gl_Position = a_position;
 }
 )SHADER";
 
+static const char* sMultiviewFragmentShader = R"SHADER(#version 300 es
+#extension GL_OES_EGL_image_external_essl3 : require
+precision mediump float;
+
+uniform samplerExternalOES u_texture0;
+
+in vec3 v_position;
+flat in vec4 v_uvRect;
+out vec4 fragColor;
+
+void main() {
+  vec2 ndc = v_position.xy / v_position.z;
+  if (v_position.z <= 0.0 || any(greaterThan(abs(ndc), vec2(1.0)))) {
+    fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+    return;
+  }
+  fragColor = texture(u_texture0, v_uvRect.xy + (ndc * 0.5 + 0.5) * v_uvRect.zw);
+}
+)SHADER";
+
+// Attribute location the multiview vertex shader declares for a_position.
+static const GLuint kMultiviewPosition = 0;
+
 static const GLfloat sVerticies[] = {
     -1.0f, 1.0f, 0.0f,
     -1.0f, -1.0f, 0.0f,
@@ -45,6 +102,84 @@ static const GLfloat sVerticies[] = {
     1.0f, -1.0f, 0.0f
 };
 
+// Offset and scale from normalized device coordinates to the content surface, which
+// is stored upside down. Used for eyes that come without a valid EyeRect.
+static const GLfloat sLeftUVRect[] = {0.0f, 1.0f, 0.5f, -1.0f};
+static const GLfloat sRightUVRect[] = {0.5f, 1.0f, 0.5f, -1.0f};
+static const GLfloat sFullUVRect[] = {0.0f, 1.0f, 1.0f, -1.0f};
+
+// Gecko measures eye rects from the top of the frame.
+static void
+EyeUVRect(const crow::device::EyeRect& aEye, const GLfloat* aDefault, GLfloat* aResult) {
+  if (aEye.mWidth <= 0.0f || aEye.mHeight <= 0.0f) {
+    memcpy(aResult, aDefault, sizeof(GLfloat) * 4);
+    return;
+  }
+  aResult[0] = aEye.mX;
+  aResult[1] = aEye.mY + aEye.mHeight;
+  aResult[2] = aEye.mWidth;
+  aResult[3] = -aEye.mHeight;
+}
+
+// Column major, as expected by glUniformMatrix3fv.
+static const GLfloat sIdentity3[] = {
+    1.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f
+};
+
+// A stale frame is reprojected for at most this many frames. Holding on to the
+// surface any longer could stall the Gecko compositor waiting for it. Only this many
+// frames after a miss are held for reprojection either; otherwise each frame is
+// returned to Gecko as soon as it has been drawn.
+static const int32_t kMaxReprojectedFrames = 4;
+
+static void
+Multiply3(const GLfloat* aLeft, const GLfloat* aRight, GLfloat* aResult) {
+  for (int column = 0; column < 3; column++) {
+    for (int row = 0; row < 3; row++) {
+      aResult[column * 3 + row] = aLeft[row] * aRight[column * 3] +
+                                  aLeft[3 + row] * aRight[column * 3 + 1] +
+                                  aLeft[6 + row] * aRight[column * 3 + 2];
+    }
+  }
+}
+
+// Homography for a pure rotation: K * R * K^-1, where K maps an eye space direction
+// to homogeneous normalized device coordinates using the eye's perspective matrix
+// and R rotates directions from the current eye space into the rendered one.
+static void
+ReprojectionMatrix(const vrb::Matrix& aPerspective, const vrb::Matrix& aRotation, GLfloat* aResult) {
+  const float a = aPerspective.At(0, 0);
+  const float b = aPerspective.At(1, 1);
+  const float c = aPerspective.At(2, 0);
+  const float d = aPerspective.At(2, 1);
+  const GLfloat projection[] = {
+      a, 0.0f, 0.0f,
+      0.0f, b, 0.0f,
+      c, d, -1.0f
+  };
+  const GLfloat inverseProjection[] = {
+      1.0f / a, 0.0f, 0.0f,
+      0.0f, 1.0f / b, 0.0f,
+      c / a, d / b, -1.0f
+  };
+  GLfloat rotation[9];
+  const vrb::Vector axes[] = {
+      aRotation.MultiplyDirection(vrb::Vector(1.0f, 0.0f, 0.0f)),
+      aRotation.MultiplyDirection(vrb::Vector(0.0f, 1.0f, 0.0f)),
+      aRotation.MultiplyDirection(vrb::Vector(0.0f, 0.0f, 1.0f))
+  };
+  for (int column = 0; column < 3; column++) {
+    rotation[column * 3] = axes[column].x();
+    rotation[column * 3 + 1] = axes[column].y();
+    rotation[column * 3 + 2] = axes[column].z();
+  }
+  GLfloat temp[9];
+  Multiply3(rotation, inverseProjection, temp);
+  Multiply3(projection, temp, aResult);
+}
+
 }
 
 namespace crow {
@@ -54,23 +189,234 @@ struct ExternalBlitter::State : public vrb::ResourceGL::State {
   GLuint fragmentShader;
   GLuint program;
   GLint aPosition;
-  GLint aUV;
   GLint uTexture0;
-  device::EyeRect eyes[device::EyeCount];
+  GLint uReprojection;
+  GLint uUVRect;
+  GLuint vertexArray;
+  GLuint vertexBuffer;
+  // Only built when the context has GL_OVR_multiview2.
+  GLuint multiviewVertexShader;
+  GLuint multiviewFragmentShader;
+  GLuint multiviewProgram;
+  GLint uMultiviewReprojection;
+  GLint uMultiviewUVRect;
+  GLuint multiviewVertexArray;
+  GLfloat eyeUVRects[device::EyeCount][4];
+  // Whether DrawQuad turned depth testing off, and the bindings it last set that
+  // GLStateCache does not track. Bindings are forgotten whenever other rendering may
+  // have run.
+  bool depthTestDisabled;
+  GLuint boundVertexArray;
+  GLuint boundTexture;
   GeckoSurfaceTexturePtr surface;
-  GLfloat leftUV[8];
-  GLfloat rightUV[8];
-  std::map<const int32_t, GeckoSurfaceTexturePtr> surfaceMap;
+  // The last content frame is kept after it is drawn so it can be reprojected if
+  // the next one is late.
+  vrb::Matrix frameHeadTransform;
+  vrb::Matrix reprojection;
+  bool reprojecting;
+  int32_t reprojectedFrames;
+  int32_t holdFrames;
+  struct SurfaceEntry {
+    GeckoSurfaceTexturePtr surface;
+    uint64_t lastUse;
+    SurfaceEntry() : lastUse(0) {}
+  };
+  // Surfaces by handle. Least recently used ones are evicted once there are more than
+  // kMaxSurfaces, as long as no frame of them is still held.
+  std::map<const int32_t, SurfaceEntry> surfaceMap;
+  uint64_t surfaceUseCount;
+  SurfaceStats surfaceStats;
   State()
       : vertexShader(0)
       , fragmentShader(0)
       , program(0)
       , aPosition(0)
-      , aUV(0)
       , uTexture0(0)
-      , leftUV{0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.0f, 0.5f, 1.0f}
-      , rightUV{0.5f, 0.0f, 0.5f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f}
+      , uReprojection(0)
+      , uUVRect(0)
+      , vertexArray(0)
+      , vertexBuffer(0)
+      , multiviewVertexShader(0)
+      , multiviewFragmentShader(0)
+      , multiviewProgram(0)
+      , uMultiviewReprojection(0)
+      , uMultiviewUVRect(0)
+      , multiviewVertexArray(0)
+      , depthTestDisabled(false)
+      , boundVertexArray(0)
+      , boundTexture(0)
+      , frameHeadTransform(vrb::Matrix::Identity())
+      , reprojection(vrb::Matrix::Identity())
+      , reprojecting(false)
+      , reprojectedFrames(0)
+      , holdFrames(0)
+      , surfaceUseCount(0)
   {}
+
+  GeckoSurfaceTexturePtr FindSurface(const int32_t aSurfaceHandle) {
+    surfaceUseCount++;
+    std::map<const int32_t, SurfaceEntry>::iterator iter = surfaceMap.find(aSurfaceHandle);
+    if (iter != surfaceMap.end()) {
+      surfaceStats.hits++;
+      iter->second.lastUse = surfaceUseCount;
+      return iter->second.surface;
+    }
+    surfaceStats.misses++;
+    VRB_LOG("Creating GeckoSurfaceTexture for handle: %d", aSurfaceHandle);
+    GeckoSurfaceTexturePtr result = GeckoSurfaceTexture::Create(aSurfaceHandle);
+    if (result) {
+      SurfaceEntry& entry = surfaceMap[aSurfaceHandle];
+      entry.surface = result;
+      entry.lastUse = surfaceUseCount;
+      EvictSurfaces();
+    }
+    return result;
+  }
+
+  void EvictSurfaces() {
+    while (surfaceMap.size() > kMaxSurfaces) {
+      std::map<const int32_t, SurfaceEntry>::iterator oldest = surfaceMap.end();
+      for (auto iter = surfaceMap.begin(); iter != surfaceMap.end(); iter++) {
+        // A surface referenced from outside the pool still has a frame held for
+        // drawing or reprojection.
+        if (iter->second.surface.use_count() > 1) {
+          continue;
+        }
+        if (oldest == surfaceMap.end() || iter->second.lastUse < oldest->second.lastUse) {
+          oldest = iter;
+        }
+      }
+      if (oldest == surfaceMap.end()) {
+        return;
+      }
+      VRB_LOG("Evicting GeckoSurfaceTexture for handle: %d", oldest->first);
+      surfaceMap.erase(oldest);
+      surfaceStats.evictions++;
+    }
+  }
+
+  void LatchSurface(const GeckoSurfaceTexturePtr& aSurface) {
+    aSurface->Latch(eglGetCurrentContext());
+    // Attaching and updating the surface texture bind it.
+    boundTexture = 0;
+  }
+
+  void ForgetBindings() {
+    boundVertexArray = 0;
+    boundTexture = 0;
+  }
+
+  // Depth testing stays off and the vertex array bound until RestoreState. Whether
+  // depth testing is on is looked up at draw time, since the frame's other rendering
+  // decides it.
+  void BindQuad(const GLuint aProgram, const GLuint aVertexArray, const GLuint aTexture) {
+    GLStateCache& glState = GLStateCache::Instance();
+    if (!depthTestDisabled && glState.IsEnabled(GL_DEPTH_TEST)) {
+      glState.Disable(GL_DEPTH_TEST);
+      depthTestDisabled = true;
+    }
+    glState.UseProgram(aProgram);
+    if (boundVertexArray != aVertexArray) {
+      VRB_GL_CHECK(glBindVertexArray(aVertexArray));
+      boundVertexArray = aVertexArray;
+    }
+    if (boundTexture != aTexture) {
+      VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
+      VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, aTexture));
+      boundTexture = aTexture;
+    }
+  }
+
+  void DrawQuad(const GLuint aTexture, const GLfloat* aReprojection, const GLfloat* aUVRect) {
+    BindQuad(program, vertexArray, aTexture);
+    VRB_GL_CHECK(glUniformMatrix3fv(uReprojection, 1, GL_FALSE, aReprojection));
+    VRB_GL_CHECK(glUniform4fv(uUVRect, 1, aUVRect));
+    VRB_GL_CHECK(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+  }
+
+  // Hands the context back the way the rest of the renderer expects it. The vertex
+  // array must be unbound so vrb's attribute setup does not modify it.
+  void RestoreState() {
+    if (depthTestDisabled) {
+      GLStateCache::Instance().Enable(GL_DEPTH_TEST);
+      depthTestDisabled = false;
+    }
+    if (boundVertexArray) {
+      VRB_GL_CHECK(glBindVertexArray(0));
+    }
+    ForgetBindings();
+  }
+
+  void EyeReprojection(const vrb::Matrix& aPerspective, GLfloat* aResult) const {
+    if (reprojecting) {
+      ReprojectionMatrix(aPerspective, reprojection, aResult);
+    } else {
+      memcpy(aResult, sIdentity3, sizeof(sIdentity3));
+    }
+  }
+
+  GLuint CreateVertexArray(const GLuint aPosition) {
+    GLuint result = 0;
+    VRB_GL_CHECK(glGenVertexArrays(1, &result));
+    VRB_GL_CHECK(glBindVertexArray(result));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer));
+    VRB_GL_CHECK(glVertexAttribPointer(aPosition, 3, GL_FLOAT, GL_FALSE, 0, nullptr));
+    VRB_GL_CHECK(glEnableVertexAttribArray(aPosition));
+    VRB_GL_CHECK(glBindVertexArray(0));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    return result;
+  }
+
+  void InitializeMultiview() {
+    if (!DeviceUtils::HasGLExtension("GL_OVR_multiview2") ||
+        !DeviceUtils::HasGLExtension("GL_OES_EGL_image_external_essl3")) {
+      return;
+    }
+    multiviewVertexShader = vrb::LoadShader(GL_VERTEX_SHADER, sMultiviewVertexShader);
+    multiviewFragmentShader = vrb::LoadShader(GL_FRAGMENT_SHADER, sMultiviewFragmentShader);
+    if (multiviewVertexShader && multiviewFragmentShader) {
+      multiviewProgram = vrb::CreateProgram(multiviewVertexShader, multiviewFragmentShader);
+    }
+    if (!multiviewProgram) {
+      VRB_ERROR("Failed to build the multiview blit program, drawing each eye separately");
+      return;
+    }
+    const GLint uTexture = vrb::GetUniformLocation(multiviewProgram, "u_texture0");
+    uMultiviewReprojection = vrb::GetUniformLocation(multiviewProgram, "u_reprojection");
+    uMultiviewUVRect = vrb::GetUniformLocation(multiviewProgram, "u_uvRect");
+    VRB_GL_CHECK(glUseProgram(multiviewProgram));
+    VRB_GL_CHECK(glUniform1i(uTexture, 0));
+    VRB_GL_CHECK(glUseProgram(0));
+    multiviewVertexArray = CreateVertexArray(kMultiviewPosition);
+  }
+
+  void ShutdownMultiview() {
+    if (multiviewVertexArray) {
+      VRB_GL_CHECK(glDeleteVertexArrays(1, &multiviewVertexArray));
+      multiviewVertexArray = 0;
+    }
+    if (multiviewProgram) {
+      VRB_GL_CHECK(glDeleteProgram(multiviewProgram));
+      multiviewProgram = 0;
+    }
+    if (multiviewVertexShader) {
+      VRB_GL_CHECK(glDeleteShader(multiviewVertexShader));
+      multiviewVertexShader = 0;
+    }
+    if (multiviewFragmentShader) {
+      VRB_GL_CHECK(glDeleteShader(multiviewFragmentShader));
+      multiviewFragmentShader = 0;
+    }
+  }
+
+  void ReleaseSurface() {
+    if (surface) {
+      // We need to detach the SurfaceTexture to prevent the Gecko WebGL compositor from getting blocked.
+      surface->ReleaseTexImage();
+      surface = nullptr;
+    }
+    reprojecting = false;
+  }
 };
 
 ExternalBlitterPtr
@@ -80,98 +426,135 @@ ExternalBlitter::Create(vrb::CreationContextPtr& aContext) {
 
 void
 ExternalBlitter::StartFrame(const int32_t aSurfaceHandle, const device::EyeRect& aLeftEye,
-                            const device::EyeRect& aRightEye) {
-  std::map<const int32_t, GeckoSurfaceTexturePtr>::iterator iter = m.surfaceMap.find(aSurfaceHandle);
-
-  if (iter == m.surfaceMap.end()) {
-    VRB_LOG("Creating GeckoSurfaceTexture for handle: %d", aSurfaceHandle);
-    m.surface = GeckoSurfaceTexture::Create(aSurfaceHandle);
-    m.surfaceMap[aSurfaceHandle] = m.surface;
-  } else {
-    m.surface = iter->second;
+                            const device::EyeRect& aRightEye, const vrb::Matrix& aFrameHeadTransform) {
+  m.ReleaseSurface();
+  m.ForgetBindings();
+  m.frameHeadTransform = aFrameHeadTransform;
+  if (m.holdFrames > 0) {
+    m.holdFrames--;
   }
-
+  m.reprojectedFrames = 0;
+  m.surface = m.FindSurface(aSurfaceHandle);
   if (!m.surface) {
     VRB_ERROR("Failed to find GeckoSurfaceTexture for handle: %d", aSurfaceHandle);
     return;
   }
 
+  m.LatchSurface(m.surface);
+  EyeUVRect(aLeftEye, sLeftUVRect, m.eyeUVRects[device::EyeIndex(device::Eye::Left)]);
+  EyeUVRect(aRightEye, sRightUVRect, m.eyeUVRects[device::EyeIndex(device::Eye::Right)]);
+}
 
-  EGLContext  ctx = eglGetCurrentContext();
-  if (!m.surface->IsAttachedToGLContext(ctx)) {
-    m.surface->AttachToGLContext(ctx);
+bool
+ExternalBlitter::StartReprojectedFrame(const vrb::Matrix& aHeadTransform) {
+  m.ForgetBindings();
+  if (!m.surface) {
+    m.holdFrames = kMaxReprojectedFrames;
+    return false;
   }
-
-  m.surface->UpdateTexImage();
-  m.eyes[device::EyeIndex(device::Eye::Left)] = aLeftEye;
-  m.eyes[device::EyeIndex(device::Eye::Right)] = aRightEye;
+  if (m.reprojectedFrames >= kMaxReprojectedFrames) {
+    m.ReleaseSurface();
+    m.holdFrames = 0;
+    return false;
+  }
+  m.holdFrames = kMaxReprojectedFrames;
+  m.reprojectedFrames++;
+  m.reprojecting = true;
+  // Rotation only: rotates directions from the current head space into the head
+  // space the frame was rendered for.
+  m.reprojection = m.frameHeadTransform.AfineInverse().PostMultiply(aHeadTransform);
+  m.reprojection.SetTranslation(vrb::Vector());
+  return true;
 }
 
 void
-ExternalBlitter::Draw(const device::Eye aEye) {
+ExternalBlitter::Draw(const device::Eye aEye, const vrb::Matrix& aPerspective) {
   if (!m.program || !m.surface) {
     VRB_ERROR("ExternalBlitter::Draw FAILED!");
     return;
   }
-  const GLboolean enabled = glIsEnabled(GL_DEPTH_TEST);
-  if (enabled) {
-    VRB_GL_CHECK(glDisable(GL_DEPTH_TEST));
-  }
-  VRB_GL_CHECK(glUseProgram(m.program));
-  VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
-  VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, m.surface->GetTextureName()));
-  //m.defaultT->Bind();
-  VRB_GL_CHECK(glUniform1i(m.uTexture0, 0));
-  VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.aPosition, 3, GL_FLOAT, GL_FALSE, 0, sVerticies));
-  VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.aPosition));
-  GLfloat* data = (aEye == device::Eye::Left ? &m.leftUV[0] : &m.rightUV[0]);
-  VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.aUV, 2, GL_FLOAT, GL_FALSE, 0, data));
-  VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.aUV));
+  GLfloat reprojection[9];
+  m.EyeReprojection(aPerspective, reprojection);
+  m.DrawQuad(m.surface->GetTextureName(), reprojection, m.eyeUVRects[device::EyeIndex(aEye)]);
+}
+
+bool
+ExternalBlitter::IsMultiviewSupported() const {
+  return m.multiviewProgram != 0;
+}
+
+void
+ExternalBlitter::DrawMultiview(const vrb::Matrix& aLeftPerspective, const vrb::Matrix& aRightPerspective) {
+  if (!m.multiviewProgram || !m.surface) {
+    VRB_ERROR("ExternalBlitter::DrawMultiview FAILED!");
+    return;
+  }
+  GLfloat reprojection[device::EyeCount * 9];
+  m.EyeReprojection(aLeftPerspective, &reprojection[device::EyeIndex(device::Eye::Left) * 9]);
+  m.EyeReprojection(aRightPerspective, &reprojection[device::EyeIndex(device::Eye::Right) * 9]);
+  m.BindQuad(m.multiviewProgram, m.multiviewVertexArray, m.surface->GetTextureName());
+  VRB_GL_CHECK(glUniformMatrix3fv(m.uMultiviewReprojection, device::EyeCount, GL_FALSE, reprojection));
+  VRB_GL_CHECK(glUniform4fv(m.uMultiviewUVRect, device::EyeCount, &m.eyeUVRects[0][0]));
   VRB_GL_CHECK(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
-  if (enabled) {
-    VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
+}
+
+GLuint
+ExternalBlitter::GetFrameTexture() const {
+  return m.surface ? m.surface->GetTextureName() : 0;
+}
+
+bool
+ExternalBlitter::DrawContentLayer(const int32_t aSurfaceHandle) {
+  if (!m.program) {
+    return false;
   }
+  GeckoSurfaceTexturePtr surface = m.FindSurface(aSurfaceHandle);
+  if (!surface) {
+    VRB_ERROR("Failed to find GeckoSurfaceTexture for content layer handle: %d", aSurfaceHandle);
+    return false;
+  }
+  m.LatchSurface(surface);
+  m.DrawQuad(surface->GetTextureName(), sIdentity3, sFullUVRect);
+  surface->ReleaseTexImage();
+  return true;
 }
 
 void
-ExternalBlitter::EndFrame() {
-  if (m.surface) {
-    // We need to detach the SurfaceTexture to prevent the Gecko WebGL compositor from getting blocked.
-    m.surface->ReleaseTexImage();
-    m.surface = nullptr;
+ExternalBlitter::EndFrame(const bool aKeepFrame) {
+  // Right after a miss the surface stays latched until the next frame arrives or
+  // reprojection gives up, so at most kMaxReprojectedFrames frames are held.
+  if (!aKeepFrame && m.holdFrames == 0) {
+    m.ReleaseSurface();
   }
+  m.reprojecting = false;
+  m.RestoreState();
 }
 
 void
 ExternalBlitter::StopPresenting() {
-
-  if (m.surface) {
-    m.surface->ReleaseTexImage();
-    m.surface = nullptr;
-  }
+  m.ReleaseSurface();
+  m.holdFrames = 0;
   m.surfaceMap.clear();
+  VRB_LOG("GeckoSurfaceTexture pool: %llu hits, %llu misses, %llu evictions",
+          (unsigned long long)m.surfaceStats.hits, (unsigned long long)m.surfaceStats.misses,
+          (unsigned long long)m.surfaceStats.evictions);
 }
 
 void
 ExternalBlitter::CancelFrame(const int32_t aSurfaceHandle) {
-  GeckoSurfaceTexturePtr surface;
-  auto iter = m.surfaceMap.find(aSurfaceHandle);
-  if (iter != m.surfaceMap.end()) {
-    surface = iter->second;
-  } else {
-    surface = GeckoSurfaceTexture::Create(aSurfaceHandle);
-  }
-
+  m.ReleaseSurface();
+  GeckoSurfaceTexturePtr surface = m.FindSurface(aSurfaceHandle);
   if (surface) {
-    EGLContext ctx = eglGetCurrentContext();
-    if (!surface->IsAttachedToGLContext(ctx)) {
-      surface->AttachToGLContext(ctx);
-    }
-    surface->UpdateTexImage();
+    m.LatchSurface(surface);
     surface->ReleaseTexImage();
   }
 }
 
+const ExternalBlitter::SurfaceStats&
+ExternalBlitter::GetSurfaceStats() const {
+  return m.surfaceStats;
+}
+
 ExternalBlitter::ExternalBlitter(State& aState, vrb::CreationContextPtr& aContext)
     : vrb::ResourceGL(aState, aContext)
     , m(aState)
@@ -188,13 +571,38 @@ ExternalBlitter::InitializeGL() {
   }
   if (m.program) {
     m.aPosition = vrb::GetAttributeLocation(m.program, "a_position");
-    m.aUV = vrb::GetAttributeLocation(m.program, "a_uv");
     m.uTexture0 = vrb::GetUniformLocation(m.program, "u_texture0");
+    m.uReprojection = vrb::GetUniformLocation(m.program, "u_reprojection");
+    m.uUVRect = vrb::GetUniformLocation(m.program, "u_uvRect");
+    // Resources are initialized before anything is drawn in a frame, while GLStateCache
+    // does not know the bound program yet.
+    VRB_GL_CHECK(glUseProgram(m.program));
+    VRB_GL_CHECK(glUniform1i(m.uTexture0, 0));
+    VRB_GL_CHECK(glUseProgram(0));
+
+    VRB_GL_CHECK(glGenBuffers(1, &m.vertexBuffer));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.vertexBuffer));
+    VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(sVerticies), sVerticies, GL_STATIC_DRAW));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    m.vertexArray = m.CreateVertexArray((GLuint)m.aPosition);
+    m.InitializeMultiview();
   }
+  m.depthTestDisabled = false;
+  m.ForgetBindings();
 }
 
 void
 ExternalBlitter::ShutdownGL() {
+  m.ShutdownMultiview();
+  if (m.vertexArray) {
+    VRB_GL_CHECK(glDeleteVertexArrays(1, &m.vertexArray));
+    m.vertexArray = 0;
+  }
+  if (m.vertexBuffer) {
+    VRB_GL_CHECK(glDeleteBuffers(1, &m.vertexBuffer));
+    m.vertexBuffer = 0;
+  }
+  m.ForgetBindings();
   if (m.program) {
     VRB_GL_CHECK(glDeleteProgram(m.program));
     m.program = 0;
@@ -203,7 +611,7 @@ ExternalBlitter::ShutdownGL() {
     VRB_GL_CHECK(glDeleteShader(m.vertexShader));
     m.vertexShader = 0;
   }
-  if (m.vertexShader) {
+  if (m.fragmentShader) {
     VRB_GL_CHECK(glDeleteShader(m.fragmentShader));
     m.fragmentShader = 0;
   }
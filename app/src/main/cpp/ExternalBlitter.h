@@ -8,6 +8,7 @@
 
 #include "vrb/MacroUtils.h"
 #include "vrb/Forward.h"
+#include "vrb/gl.h"
 #include "vrb/ResourceGL.h"
 #include "Device.h"
 #include "ExternalVR.h"
@@ -20,12 +21,38 @@ typedef std::shared_ptr<ExternalBlitter> ExternalBlitterPtr;
 
 class ExternalBlitter : protected vrb::ResourceGL {
 public:
+  struct SurfaceStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    SurfaceStats() : hits(0), misses(0), evictions(0) {}
+  };
+
   static ExternalBlitterPtr Create(vrb::CreationContextPtr& aContext);
-  void StartFrame(const int32_t aSurfaceHandle, const device::EyeRect& aLeftEye, const device::EyeRect& aRightEye);
-  void Draw(const device::Eye aEye);
-  void EndFrame();
+  // aFrameHeadTransform is the head pose content rendered the frame with.
+  void StartFrame(const int32_t aSurfaceHandle, const device::EyeRect& aLeftEye, const device::EyeRect& aRightEye,
+                  const vrb::Matrix& aFrameHeadTransform);
+  // Draws the previous content frame again, rotated to aHeadTransform. Returns false
+  // if there is no frame to reproject. Frames are only held for reprojection for a
+  // few frames after content misses a deadline, and a held frame is released as soon
+  // as a new one is latched.
+  bool StartReprojectedFrame(const vrb::Matrix& aHeadTransform);
+  void Draw(const device::Eye aEye, const vrb::Matrix& aPerspective);
+  // Whether DrawMultiview can be used, which needs GL_OVR_multiview2.
+  bool IsMultiviewSupported() const;
+  // Draws both eyes in one pass into a framebuffer bound with BindMultiviewEyes.
+  void DrawMultiview(const vrb::Matrix& aLeftPerspective, const vrb::Matrix& aRightPerspective);
+  // The GL_TEXTURE_EXTERNAL_OES texture holding the current frame, or 0 if there is none.
+  GLuint GetFrameTexture() const;
+  // Copies the latest frame of a 2D content layer into the bound framebuffer.
+  bool DrawContentLayer(const int32_t aSurfaceHandle);
+  // aKeepFrame keeps the frame latched until the next one, e.g. while a device
+  // compositor samples it.
+  void EndFrame(const bool aKeepFrame);
   void StopPresenting();
   void CancelFrame(const int32_t aSurfaceHandle);
+  // Lookups of the surface pool since the blitter was created.
+  const SurfaceStats& GetSurfaceStats() const;
 protected:
   struct State;
   ExternalBlitter(State& aState, vrb::CreationContextPtr& aContext);
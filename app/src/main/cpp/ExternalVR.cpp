@@ -4,20 +4,88 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "ExternalVR.h"
+#include "ImmersiveTelemetry.h"
+#include "PosePredictor.h"
 #include "VRBrowser.h"
 
+#include "vrb/Logger.h"
 #include "vrb/Matrix.h"
 #include "vrb/Quaternion.h"
 #include "vrb/Vector.h"
 #include "moz_external_vr.h"
+#include <algorithm>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 
 namespace {
 
-const float SecondsToNanoseconds = 1e9f;
-const int SecondsToNanosecondsI32 = int(1e9);
-const int MicrosecondsToNanoseconds = 1000;
+const double SecondsToNanoseconds = 1e9;
+const double SecondsToMicroseconds = 1e6;
+// Upper bound on how long the render thread waits for a WebVR frame.
+const double kMaxFrameWait = 0.1;
+// Wait used when the device can not predict its display time.
+const double kDefaultFrameWait = 0.008;
+// Time reserved before the predicted display time to submit the frame, as a part of
+// the display period. The measured blit time is added, up to kMaxSubmitMargin.
+const double kSubmitMargin = 0.25;
+const double kMaxSubmitMargin = 0.75;
+// Display period assumed until it is measured from successive display times, and the
+// range of periods that are measured instead of being taken for skipped frames.
+const double kDefaultDisplayPeriod = 1.0 / 60.0;
+const double kMinDisplayPeriod = 1.0 / 240.0;
+const double kMaxDisplayPeriod = 1.0 / 30.0;
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+// VRExternalShmem::size reported to Gecko, which excludes the seqlock extension.
+const int32_t kLegacyShmemSize = offsetof(mozilla::gfx::VRExternalShmem, systemSeqLockVersion);
+const int kSeqLockReadAttempts = 4;
+const double kSeqLockPollInterval = 0.0005;
+#else
+const int32_t kLegacyShmemSize = sizeof(mozilla::gfx::VRExternalShmem);
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+// Poses are predicted ahead by the measured content latency, up to this limit.
+const double kMaxContentLatency = 0.05;
+// Weight of the newest latency measurement.
+const double kLatencySmoothing = 0.1;
+// Published head poses are kept for as many frames as PosePredictor keeps samples.
+const uint32_t kPoseHistory = 64;
+
+// Sections of VRSystemState that changed since they were last published.
+const uint32_t kDirtyDisplay = 1 << 0;
+const uint32_t kDirtySensor = 1 << 1;
+const uint32_t kDirtyControllers = 1 << 2;
+const uint32_t kDirtyAll = kDirtyDisplay | kDirtySensor | kDirtyControllers;
+
+// Parts of a VRControllerState that changed since it was last published. The pose
+// of an active controller changes every frame, the rest rarely does.
+const uint32_t kControllerDescriptor = 1 << 0;
+const uint32_t kControllerButtons = 1 << 1;
+const uint32_t kControllerAxes = 1 << 2;
+const uint32_t kControllerPose = 1 << 3;
+const uint32_t kControllerAll = kControllerDescriptor | kControllerButtons | kControllerAxes | kControllerPose;
+
+// Copies the bytes of aSource between the aBegin and aEnd offsets into aDestination.
+void
+CopyRange(mozilla::gfx::VRControllerState& aDestination, const mozilla::gfx::VRControllerState& aSource,
+          const size_t aBegin, const size_t aEnd) {
+  memcpy(reinterpret_cast<char*>(&aDestination) + aBegin, reinterpret_cast<const char*>(&aSource) + aBegin,
+         aEnd - aBegin);
+}
+
+double
+MonotonicSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return double(ts.tv_sec) + double(ts.tv_nsec) / SecondsToNanoseconds;
+}
+
+struct timespec
+ToTimespec(const double aSeconds) {
+  struct timespec ts;
+  ts.tv_sec = time_t(aSeconds);
+  ts.tv_nsec = long((aSeconds - double(ts.tv_sec)) * SecondsToNanoseconds);
+  return ts;
+}
 
 class Lock {
   pthread_mutex_t& mMutex;
@@ -45,6 +113,28 @@ private:
   VRB_NO_NEW_DELETE
 };
 
+// Records the lifetime of the scope into a telemetry histogram, in microseconds.
+class TelemetryTimer {
+  crow::ImmersiveTelemetry& mTelemetry;
+  const crow::TelemetryMetric mMetric;
+  const double mStart;
+public:
+  TelemetryTimer(crow::ImmersiveTelemetry& aTelemetry, const crow::TelemetryMetric aMetric)
+      : mTelemetry(aTelemetry)
+      , mMetric(aMetric)
+      , mStart(MonotonicSeconds())
+  {}
+
+  ~TelemetryTimer() {
+    mTelemetry.AddSample(mMetric, int64_t((MonotonicSeconds() - mStart) * SecondsToMicroseconds));
+  }
+
+private:
+  TelemetryTimer() = delete;
+  VRB_NO_DEFAULTS(TelemetryTimer)
+  VRB_NO_NEW_DELETE
+};
+
 class Wait {
   pthread_mutex_t& mMutex;
   pthread_cond_t& mCond;
@@ -62,33 +152,17 @@ public:
     }
   }
 
-  bool DoWait(const float aWait) {
+  // aDeadline is in seconds on the CLOCK_MONOTONIC timeline, which the condition
+  // variables are configured to use.
+  bool DoWait(const double aDeadline) {
     if (mLocked || pthread_mutex_lock(&mMutex) == 0) {
       mLocked = true;
-      if (aWait == 0.0f) {
-        return pthread_cond_wait(&mCond, &mMutex) == 0;
-      } else {
-        float sec = 0;
-        float nsec = modff(aWait, &sec);
-        struct timeval tv;
-        struct timespec ts;
-        gettimeofday(&tv, NULL);
-        ts.tv_sec = tv.tv_sec + int(sec);
-        ts.tv_nsec = (tv.tv_usec * MicrosecondsToNanoseconds) + int(SecondsToNanoseconds * nsec);
-        if (ts.tv_nsec >= SecondsToNanosecondsI32) {
-          ts.tv_nsec -= SecondsToNanosecondsI32;
-          ts.tv_sec++;
-        }
-        return pthread_cond_timedwait(&mCond, &mMutex, &ts) == 0;
-      }
+      const struct timespec ts = ToTimespec(aDeadline);
+      return pthread_cond_timedwait(&mCond, &mMutex, &ts) == 0;
     }
     return false;
   }
 
-  bool DoWait() {
-    return DoWait(0.0f);
-  }
-
   bool IsLocked() {
     return mLocked;
   }
@@ -124,18 +198,58 @@ struct ExternalVR::State {
   mozilla::gfx::VRExternalShmem data;
   mozilla::gfx::VRSystemState system;
   mozilla::gfx::VRBrowserState browser;
+  mozilla::gfx::VRBrowserState pendingBrowser;
   device::CapabilityFlags deviceCapabilities;
   vrb::Vector eyeOffsets[device::EyeCount];
   uint64_t lastFrameId;
   bool firstPresentingFrame;
   bool compositorEnabled;
   bool waitingForExit;
+  bool seqLock;
+  uint32_t dirty;
+  int32_t immersiveLayer;
+  bool controllerActive[mozilla::gfx::kVRControllerMaxCount];
+  uint32_t controllerDirty[mozilla::gfx::kVRControllerMaxCount];
+  uint32_t presentedFrames;
+  uint32_t missedDeadlines;
+  PosePredictorPtr headPredictor;
+  PosePredictorPtr controllerPredictors[mozilla::gfx::kVRControllerMaxCount];
+  double contentLatency;
+  // The head pose published with each inputFrameID, as content rendered with it.
+  struct PublishedPose {
+    double time;
+    PoseSample head;
+  };
+  PublishedPose publishedPoses[kPoseHistory];
+  uint64_t frameInputId;
+  bool frameHeadKnown;
+  PoseSample frameHead;
+  double frameLatency;
+  double lastDisplayTime;
+  double displayPeriod;
+  double blitTime;
+  ImmersiveTelemetryPtr telemetry;
+
+  State() : deviceCapabilities(0), seqLock(false), dirty(kDirtyAll), immersiveLayer(0),
+            presentedFrames(0), missedDeadlines(0), contentLatency(0.0), frameInputId(0), frameHeadKnown(false), frameLatency(0.0),
+            lastDisplayTime(0.0), displayPeriod(kDefaultDisplayPeriod), blitTime(0.0) {
+    headPredictor = PosePredictor::Create();
+    telemetry = ImmersiveTelemetry::Create();
+    for (PosePredictorPtr& predictor: controllerPredictors) {
+      predictor = PosePredictor::Create();
+    }
+  }
 
-  State() : deviceCapabilities(0) {
+  // Called after Reset() clears the shared block.
+  void InitializeSyncObjects() {
     pthread_mutex_init(&data.systemMutex, nullptr);
     pthread_mutex_init(&data.browserMutex, nullptr);
-    pthread_cond_init(&data.systemCond, nullptr);
-    pthread_cond_init(&data.browserCond, nullptr);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&data.systemCond, &attributes);
+    pthread_cond_init(&data.browserCond, &attributes);
+    pthread_condattr_destroy(&attributes);
   }
 
   ~State() {
@@ -147,10 +261,14 @@ struct ExternalVR::State {
 
   void Reset() {
     memset(&data, 0, sizeof(mozilla::gfx::VRExternalShmem));
+    InitializeSyncObjects();
     memset(&system, 0, sizeof(mozilla::gfx::VRSystemState));
     memset(&browser, 0, sizeof(mozilla::gfx::VRBrowserState));
     data.version = mozilla::gfx::kVRExternalVersion;
-    data.size = sizeof(mozilla::gfx::VRExternalShmem);
+    data.size = kLegacyShmemSize;
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    data.systemSeqLockVersion = mozilla::gfx::kVRExternalSeqLockVersion;
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
     system.displayState.mIsConnected = true;
     system.displayState.mIsMounted = true;
     const vrb::Matrix identity = vrb::Matrix::Identity();
@@ -160,6 +278,145 @@ struct ExternalVR::State {
     lastFrameId = 0;
     firstPresentingFrame = false;
     waitingForExit = false;
+    seqLock = false;
+    dirty = kDirtyAll;
+    immersiveLayer = 0;
+    memset(controllerActive, 0, sizeof(controllerActive));
+    memset(controllerDirty, 0, sizeof(controllerDirty));
+    presentedFrames = 0;
+    missedDeadlines = 0;
+    ResetPrediction();
+  }
+
+  void ResetPrediction() {
+    headPredictor->Reset();
+    for (PosePredictorPtr& predictor: controllerPredictors) {
+      predictor->Reset();
+    }
+    contentLatency = 0.0;
+    memset(publishedPoses, 0, sizeof(publishedPoses));
+    frameInputId = 0;
+    frameHeadKnown = false;
+    frameLatency = 0.0;
+    lastDisplayTime = 0.0;
+    blitTime = 0.0;
+  }
+
+  // Records aTransform as the pose at aSampleTime and returns it predicted to
+  // aTargetTime, when content is expected to display the frame rendered with it.
+  vrb::Matrix PredictTransform(PosePredictor& aPredictor, const vrb::Matrix& aTransform,
+                               const double aSampleTime, const double aTargetTime, PoseSample& aSample) {
+    const vrb::Quaternion orientation(aTransform);
+    const vrb::Vector position = aTransform.GetTranslation();
+    aPredictor.AddSample(system.sensorState.inputFrameID, aSampleTime, orientation.Data(), position.Data());
+    aPredictor.Predict(aTargetTime, aSample);
+    return PoseTransform(aSample);
+  }
+
+  static vrb::Matrix PoseTransform(const PoseSample& aSample) {
+    vrb::Matrix result = vrb::Matrix::Rotation(vrb::Quaternion(aSample.orientation[0], aSample.orientation[1],
+                                                                aSample.orientation[2], aSample.orientation[3]));
+    result.SetTranslation(vrb::Vector(aSample.position[0], aSample.position[1], aSample.position[2]));
+    return result;
+  }
+
+  // Copies only the sections of the system state that changed into the shared block.
+  void PublishDirtySections() {
+    if (dirty & kDirtyDisplay) {
+      data.state.enumerationCompleted = system.enumerationCompleted;
+      memcpy(&(data.state.displayState), &(system.displayState), sizeof(mozilla::gfx::VRDisplayState));
+    }
+    if (dirty & kDirtySensor) {
+      memcpy(&(data.state.sensorState), &(system.sensorState), sizeof(mozilla::gfx::VRHMDSensorState));
+    }
+    if (dirty & kDirtyControllers) {
+      for (int32_t index = 0; index < mozilla::gfx::kVRControllerMaxCount; index++) {
+        PublishController(index);
+      }
+    }
+    dirty = 0;
+  }
+
+  void PublishController(const int32_t aIndex) {
+    typedef mozilla::gfx::VRControllerState ControllerState;
+    const uint32_t changed = controllerDirty[aIndex];
+    const ControllerState& source = system.controllerState[aIndex];
+    ControllerState& destination = data.state.controllerState[aIndex];
+    if (changed == kControllerAll) {
+      memcpy(&destination, &source, sizeof(ControllerState));
+    } else {
+      if (changed & kControllerDescriptor) {
+        CopyRange(destination, source, 0, offsetof(ControllerState, buttonPressed));
+        destination.flags = source.flags;
+      }
+      if (changed & kControllerButtons) {
+        CopyRange(destination, source, offsetof(ControllerState, buttonPressed), offsetof(ControllerState, axisValue));
+      }
+      if (changed & kControllerAxes) {
+        CopyRange(destination, source, offsetof(ControllerState, axisValue), offsetof(ControllerState, flags));
+      }
+      if (changed & kControllerPose) {
+        CopyRange(destination, source, offsetof(ControllerState, pose), sizeof(ControllerState));
+      }
+    }
+    controllerDirty[aIndex] = 0;
+  }
+
+  // Writes the parts of aController that changed into controller slot aIndex.
+  void UpdateController(const int32_t aIndex, Controller& aController, const double aSampleTime, const double aTargetTime) {
+    mozilla::gfx::VRControllerState& immersiveController = system.controllerState[aIndex];
+    const bool active = aController.enabled && !aController.immersiveName.empty();
+    if (!active) {
+      if (controllerActive[aIndex]) {
+        memset(&immersiveController, 0, sizeof(mozilla::gfx::VRControllerState));
+        controllerActive[aIndex] = false;
+        controllerDirty[aIndex] = kControllerAll;
+      }
+      return;
+    }
+    uint32_t changed = aController.immersiveDirty;
+    if (!controllerActive[aIndex]) {
+      changed = kImmersiveAllDirty;
+      controllerActive[aIndex] = true;
+    }
+    aController.immersiveDirty = 0;
+
+    if (changed & kImmersiveDescriptorDirty) {
+      const size_t length = std::min(aController.immersiveName.size(), sizeof(immersiveController.controllerName) - 1);
+      memset(immersiveController.controllerName, 0, sizeof(immersiveController.controllerName));
+      memcpy(immersiveController.controllerName, aController.immersiveName.c_str(), length);
+      immersiveController.hand = aController.leftHanded ? mozilla::gfx::ControllerHand::Left : mozilla::gfx::ControllerHand::Right;
+      immersiveController.numButtons = aController.numButtons;
+      immersiveController.numAxes = aController.numAxes;
+      immersiveController.flags = mozilla::gfx::ControllerCapabilityFlags::Cap_Orientation;
+      controllerDirty[aIndex] |= kControllerDescriptor;
+    }
+    if (changed & kImmersiveButtonsDirty) {
+      immersiveController.buttonPressed = aController.immersivePressedState;
+      immersiveController.buttonTouched = aController.immersiveTouchedState;
+      memset(immersiveController.triggerValue, 0, sizeof(immersiveController.triggerValue));
+      for (int i = 0; i < aController.numButtons; ++i) {
+        immersiveController.triggerValue[i] = aController.immersiveTriggerValues[i];
+      }
+      controllerDirty[aIndex] |= kControllerButtons;
+    }
+    if (changed & kImmersiveAxesDirty) {
+      memset(immersiveController.axisValue, 0, sizeof(immersiveController.axisValue));
+      for (int i = 0; i < aController.numAxes; ++i) {
+        immersiveController.axisValue[i] = aController.immersiveAxes[i];
+      }
+      controllerDirty[aIndex] |= kControllerAxes;
+    }
+
+    immersiveController.isOrientationValid = true;
+    PoseSample pose;
+    const vrb::Matrix transform = PredictTransform(*controllerPredictors[aIndex], aController.transformMatrix,
+                                                   aSampleTime, aTargetTime, pose);
+    vrb::Quaternion quaternion(transform);
+    quaternion = quaternion.Inverse();
+    memcpy(&(immersiveController.pose.orientation), quaternion.Data(), sizeof(immersiveController.pose.orientation));
+    memcpy(&(immersiveController.pose.angularVelocity), pose.angularVelocity, sizeof(immersiveController.pose.angularVelocity));
+    controllerDirty[aIndex] |= kControllerPose;
   }
 
   static ExternalVR::State& Instance() {
@@ -170,23 +427,164 @@ struct ExternalVR::State {
     return *sState;
   }
 
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+  // Gecko builds that support the seqlock extension advertise it once they attach.
+  bool UseSeqLock() {
+    if (!seqLock &&
+        __atomic_load_n(&data.browserSeqLockVersion, __ATOMIC_ACQUIRE) >= mozilla::gfx::kVRExternalSeqLockVersion) {
+      VRB_LOG("ExternalVR: using seqlock shared memory protocol");
+      seqLock = true;
+    }
+    return seqLock;
+  }
+
+  void PushSystemStateSeqLock() {
+    // We are the only writer of the system state.
+    const int64_t generation = data.systemGenerationA + 1;
+    __atomic_store_n(&data.systemGenerationA, generation, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    PublishDirtySections();
+    __atomic_store_n(&data.systemGenerationB, generation, __ATOMIC_RELEASE);
+  }
+
+  // Returns false if every attempt raced with Gecko writing the browser state, in
+  // which case the previous state is kept.
+  bool PullBrowserStateSeqLock() {
+    for (int attempt = 0; attempt < kSeqLockReadAttempts; attempt++) {
+      const int64_t generationB = __atomic_load_n(&data.browserGenerationB, __ATOMIC_ACQUIRE);
+      memcpy(&pendingBrowser, &data.browserState, sizeof(mozilla::gfx::VRBrowserState));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&data.browserGenerationA, __ATOMIC_RELAXED) == generationB) {
+        ApplyBrowserState(pendingBrowser);
+        return true;
+      }
+    }
+    return false;
+  }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+
   void PullBrowserStateWhileLocked() {
-    const bool wasPresenting = IsPresenting();
-    memcpy(&browser, &data.browserState, sizeof(mozilla::gfx::VRBrowserState));
+    ApplyBrowserState(data.browserState);
+  }
 
+  void ApplyBrowserState(const mozilla::gfx::VRBrowserState& aState) {
+    const bool wasPresenting = IsPresenting();
+    memcpy(&browser, &aState, sizeof(mozilla::gfx::VRBrowserState));
+    immersiveLayer = 0;
+    for (int32_t index = 0; index < mozilla::gfx::kVRLayerMaxCount; index++) {
+      if (browser.layerState[index].type == mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive) {
+        immersiveLayer = index;
+        break;
+      }
+    }
 
     if ((!wasPresenting && IsPresenting()) || browser.navigationTransitionActive) {
       firstPresentingFrame = true;
     }
+    if (!wasPresenting && IsPresenting()) {
+      presentedFrames = 0;
+      missedDeadlines = 0;
+      ResetPrediction();
+      telemetry->Reset();
+    }
     if (wasPresenting && !IsPresenting()) {
-      lastFrameId = browser.layerState[0].layer_stereo_immersive.mFrameId;
+      VRB_LOG("ExternalVR: presented %u frames, missed %u frame deadlines", presentedFrames, missedDeadlines);
+      lastFrameId = ImmersiveLayer().mFrameId;
       waitingForExit = false;
     }
   }
 
+  // The stereo projection layer. Any other layers are 2D content drawn on top of it.
+  const mozilla::gfx::VRLayerState& ImmersiveLayerState() const {
+    return browser.layerState[immersiveLayer];
+  }
+
+  const mozilla::gfx::VRLayer_Stereo_Immersive& ImmersiveLayer() const {
+    return ImmersiveLayerState().layer_stereo_immersive;
+  }
+
   bool IsPresenting() const {
-    return browser.presentationActive || browser.navigationTransitionActive || browser.layerState[0].type == mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive;
+    return browser.presentationActive || browser.navigationTransitionActive || ImmersiveLayerState().type == mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive;
+  }
+
+  bool IsFrameReady() const {
+    return !IsPresenting() || ImmersiveLayer().mFrameId != lastFrameId;
+  }
+
+  // The previous content frame is shown again.
+  void MissFrame() {
+    missedDeadlines++;
+    telemetry->RecordFrameId(lastFrameId);
   }
+
+  void AcceptFrame() {
+    firstPresentingFrame = false;
+    system.displayState.mLastSubmittedFrameSuccessful = true;
+    system.displayState.mLastSubmittedFrameId = ImmersiveLayer().mFrameId;
+    dirty |= kDirtyDisplay;
+    lastFrameId = ImmersiveLayer().mFrameId;
+    presentedFrames++;
+    telemetry->RecordFrameId(lastFrameId);
+    // Measure how long content took to turn the pose it used into a frame. Samples
+    // are timestamped with the display time they were predicted for, so the time
+    // past it is the extra latency prediction has to cover.
+    PoseSample sample;
+    frameInputId = ImmersiveLayer().mInputFrameId;
+    const PublishedPose& published = publishedPoses[frameInputId % kPoseHistory];
+    frameHeadKnown = frameInputId != 0 && published.head.inputFrameID == frameInputId;
+    if (frameHeadKnown) {
+      frameHead = published.head;
+    }
+    if (headPredictor->FindSample(frameInputId, sample)) {
+      const double now = MonotonicSeconds();
+      frameLatency = now - published.time;
+      const double latency = std::max(0.0, std::min(now - sample.time, kMaxContentLatency));
+      contentLatency = contentLatency > 0.0 ? contentLatency + kLatencySmoothing * (latency - contentLatency)
+                                            : latency;
+      telemetry->AddSample(TelemetryMetric::PoseLatency, int64_t(frameLatency * SecondsToMicroseconds));
+    }
+  }
+
+  void UpdateDisplayPeriod(const double aPredictedDisplayTime) {
+    const double period = aPredictedDisplayTime - lastDisplayTime;
+    if (lastDisplayTime > 0.0 && period >= kMinDisplayPeriod && period <= kMaxDisplayPeriod) {
+      displayPeriod += kLatencySmoothing * (period - displayPeriod);
+    }
+    lastDisplayTime = aPredictedDisplayTime;
+  }
+
+  // The frame has to be ready early enough before it is displayed to be blitted
+  // and submitted, which always leaves part of the display period to wait in. The
+  // wait is never longer than kMaxFrameWait.
+  double FrameDeadline(const double aPredictedDisplayTime) {
+    const double now = MonotonicSeconds();
+    if (aPredictedDisplayTime <= 0.0) {
+      return now + kDefaultFrameWait;
+    }
+    UpdateDisplayPeriod(aPredictedDisplayTime);
+    const double margin = std::min(kSubmitMargin * displayPeriod + blitTime, kMaxSubmitMargin * displayPeriod);
+    return std::max(now, std::min(aPredictedDisplayTime - margin, now + kMaxFrameWait));
+  }
+
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+  bool WaitFrameResultSeqLock(const double aDeadline) {
+    PullBrowserStateSeqLock();
+    while (!IsFrameReady()) {
+      if (firstPresentingFrame) {
+        return true; // Do not block to show loading screen until the first frame arrives.
+      }
+      const double remaining = aDeadline - MonotonicSeconds();
+      if (remaining <= 0.0) {
+        MissFrame();
+        return false;
+      }
+      usleep(useconds_t(std::min(remaining, kSeqLockPollInterval) * SecondsToMicroseconds));
+      PullBrowserStateSeqLock();
+    }
+    AcceptFrame();
+    return true;
+  }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
 };
 
 ExternalVR::State * ExternalVR::State::sState = nullptr;
@@ -210,6 +608,7 @@ ExternalVR::SetDeviceName(const std::string& aName) {
   strncpy(m.system.displayState.mDisplayName, aName.c_str(),
           mozilla::gfx::kVRDisplayNameMaxLen - 1);
   m.system.displayState.mDisplayName[mozilla::gfx::kVRDisplayNameMaxLen - 1] = '\0';
+  m.dirty |= kDirtyDisplay;
 }
 
 void
@@ -239,6 +638,7 @@ ExternalVR::SetCapabilityFlags(const device::CapabilityFlags aFlags) {
   m.deviceCapabilities = aFlags;
   m.system.displayState.mCapabilityFlags = static_cast<mozilla::gfx::VRDisplayCapabilityFlags>(result);
   m.system.sensorState.flags = m.system.displayState.mCapabilityFlags;
+  m.dirty |= kDirtyDisplay | kDirtySensor;
 }
 
 void
@@ -253,6 +653,7 @@ ExternalVR::SetFieldOfView(const device::Eye aEye, const double aLeftDegrees,
   m.system.displayState.mEyeFOV[which].rightDegrees = aRightDegrees;
   m.system.displayState.mEyeFOV[which].downDegrees = aBottomDegrees;
   m.system.displayState.mEyeFOV[which].leftDegrees = aLeftDegrees;
+  m.dirty |= kDirtyDisplay;
 }
 
 void
@@ -263,6 +664,7 @@ ExternalVR::SetEyeOffset(const device::Eye aEye, const float aX, const float aY,
   m.system.displayState.mEyeTranslation[which].x = aX;
   m.system.displayState.mEyeTranslation[which].y = aY;
   m.system.displayState.mEyeTranslation[which].z = aZ;
+  m.dirty |= kDirtyDisplay;
   m.eyeOffsets[device::EyeIndex(aEye)].Set(aX, aY, aZ);
 }
 
@@ -270,19 +672,35 @@ void
 ExternalVR::SetEyeResolution(const int32_t aWidth, const int32_t aHeight) {
   m.system.displayState.mEyeResolution.width = aWidth;
   m.system.displayState.mEyeResolution.height = aHeight;
+  m.dirty |= kDirtyDisplay;
 }
 
 void
 ExternalVR::PushSystemState() {
+  if (!m.dirty) {
+    return;
+  }
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+  if (m.UseSeqLock()) {
+    m.PushSystemStateSeqLock();
+    return;
+  }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
   Lock lock(m.data.systemMutex);
   if (lock.IsLocked()) {
-    memcpy(&(m.data.state), &(m.system), sizeof(mozilla::gfx::VRSystemState));
+    m.PublishDirtySections();
     pthread_cond_signal(&m.data.systemCond);
   }
 }
 
 void
 ExternalVR::PullBrowserState() {
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+  if (m.UseSeqLock()) {
+    m.PullBrowserStateSeqLock();
+    return;
+  }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
   Lock lock(m.data.browserMutex);
   if (lock.IsLocked()) {
    m.PullBrowserStateWhileLocked();
@@ -302,9 +720,11 @@ ExternalVR::SetCompositorEnabled(bool aEnabled) {
     m.system.displayState.mSuppressFrames = true;
     m.system.displayState.mLastSubmittedFrameId = 0;
     m.lastFrameId = 0;
+    m.dirty |= kDirtyDisplay;
     PushSystemState();
     VRBrowser::PauseCompositor();
     m.system.displayState.mSuppressFrames = false;
+    m.dirty |= kDirtyDisplay;
     PushSystemState();
   }
 }
@@ -320,7 +740,7 @@ ExternalVR::GetVRState() const {
     return VRState::NotPresenting;
   } else if (m.browser.navigationTransitionActive) {
     return VRState::LinkTraversal;
-  } else if (m.firstPresentingFrame || m.waitingForExit || m.browser.layerState[0].type != mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive) {
+  } else if (m.firstPresentingFrame || m.waitingForExit || m.ImmersiveLayerState().type != mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive) {
     return VRState::Loading;
   }
 
@@ -328,16 +748,35 @@ ExternalVR::GetVRState() const {
 }
 
 void
-ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<Controller>& aControllers) {
-  const vrb::Matrix inverseHeadTransform = aHeadTransform.Inverse();
+ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, std::vector<Controller>& aControllers,
+                           const double aPredictedDisplayTime) {
+  // The device poses are already predicted to aPredictedDisplayTime, so they are
+  // recorded as of that time and only extrapolated by the content latency.
+  const double now = MonotonicSeconds();
+  const double sampleTime = aPredictedDisplayTime > 0.0 ? aPredictedDisplayTime : now;
+  const double targetTime = sampleTime + m.contentLatency;
+  m.system.sensorState.inputFrameID++;
+  m.system.sensorState.timestamp = now;
+  PoseSample head;
+  const vrb::Matrix headTransform = m.PredictTransform(*m.headPredictor, aHeadTransform, sampleTime, targetTime, head);
+  State::PublishedPose& published = m.publishedPoses[m.system.sensorState.inputFrameID % kPoseHistory];
+  published.time = now;
+  published.head = head;
+  published.head.inputFrameID = m.system.sensorState.inputFrameID;
+  const vrb::Matrix inverseHeadTransform = headTransform.Inverse();
   vrb::Quaternion quaternion(inverseHeadTransform);
-  vrb::Vector translation = aHeadTransform.GetTranslation();
   memcpy(&(m.system.sensorState.pose.orientation), quaternion.Data(),
          sizeof(m.system.sensorState.pose.orientation));
-  memcpy(&(m.system.sensorState.pose.position), translation.Data(),
+  memcpy(&(m.system.sensorState.pose.position), head.position,
          sizeof(m.system.sensorState.pose.position));
-  m.system.sensorState.inputFrameID++;
-  m.system.displayState.mLastSubmittedFrameId = m.lastFrameId;
+  memcpy(&(m.system.sensorState.pose.angularVelocity), head.angularVelocity,
+         sizeof(m.system.sensorState.pose.angularVelocity));
+  memcpy(&(m.system.sensorState.pose.linearVelocity), head.linearVelocity,
+         sizeof(m.system.sensorState.pose.linearVelocity));
+  if (m.system.displayState.mLastSubmittedFrameId != m.lastFrameId) {
+    m.system.displayState.mLastSubmittedFrameId = m.lastFrameId;
+    m.dirty |= kDirtyDisplay;
+  }
 
   vrb::Matrix leftView = vrb::Matrix::Position(-m.eyeOffsets[device::EyeIndex(device::Eye::Left)]).PostMultiply(inverseHeadTransform);
   vrb::Matrix rightView = vrb::Matrix::Position(-m.eyeOffsets[device::EyeIndex(device::Eye::Right)]).PostMultiply(inverseHeadTransform);
@@ -347,58 +786,48 @@ ExternalVR::PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<
          sizeof(m.system.sensorState.rightViewMatrix));
 
 
-  memset(m.system.controllerState, 0, sizeof(m.system.controllerState));
-  for (int i = 0; i < aControllers.size(); ++i) {
-    const Controller& controller = aControllers[i];
-    if (controller.immersiveName.empty() || !controller.enabled) {
-      continue;
-    }
-    mozilla::gfx::VRControllerState& immersiveController = m.system.controllerState[i];
-    memcpy(immersiveController.controllerName, controller.immersiveName.c_str(), controller.immersiveName.size() + 1);
-    immersiveController.numButtons = controller.numButtons;
-    immersiveController.buttonPressed = controller.immersivePressedState;
-    immersiveController.buttonTouched = controller.immersiveTouchedState;
-    for (int i = 0; i< controller.numButtons; ++i) {
-      immersiveController.triggerValue[i] = controller.immersiveTriggerValues[i];
-    }
-    immersiveController.numAxes = controller.numAxes;
-    for (int i = 0; i< controller.numAxes; ++i) {
-      immersiveController.axisValue[i] = controller.immersiveAxes[i];
+  m.dirty |= kDirtySensor | kDirtyControllers;
+  const int32_t count = std::min((int32_t)aControllers.size(), (int32_t)mozilla::gfx::kVRControllerMaxCount);
+  for (int32_t i = 0; i < count; ++i) {
+    m.UpdateController(i, aControllers[i], sampleTime, targetTime);
+  }
+  for (int32_t i = count; i < mozilla::gfx::kVRControllerMaxCount; ++i) {
+    if (m.controllerActive[i]) {
+      memset(&(m.system.controllerState[i]), 0, sizeof(mozilla::gfx::VRControllerState));
+      m.controllerActive[i] = false;
+      m.controllerDirty[i] = kControllerAll;
     }
-    immersiveController.hand = controller.leftHanded ? mozilla::gfx::ControllerHand::Left : mozilla::gfx::ControllerHand::Right;
-
-    immersiveController.flags = mozilla::gfx::ControllerCapabilityFlags::Cap_Orientation;
-    immersiveController.isOrientationValid = true;
-    vrb::Quaternion quaternion(controller.transformMatrix);
-    quaternion = quaternion.Inverse();
-    memcpy(&(immersiveController.pose.orientation), quaternion.Data(), sizeof(immersiveController.pose.orientation));
   }
 
   PushSystemState();
 }
 
 bool
-ExternalVR::WaitFrameResult() {
+ExternalVR::WaitFrameResult(const double aPredictedDisplayTime) {
+  const double deadline = m.FrameDeadline(aPredictedDisplayTime);
+  TelemetryTimer timer(*m.telemetry, TelemetryMetric::FrameWait);
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+  if (m.UseSeqLock()) {
+    return m.WaitFrameResultSeqLock(deadline);
+  }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
   Wait wait(m.data.browserMutex, m.data.browserCond);
   wait.Lock();
   // browserMutex is locked in wait.lock().
   m.PullBrowserStateWhileLocked();
   while (true) {
-    if (!IsPresenting() || m.browser.layerState[0].layer_stereo_immersive.mFrameId != m.lastFrameId) {
-      m.firstPresentingFrame = false;
-      m.system.displayState.mLastSubmittedFrameSuccessful = true;
-      m.system.displayState.mLastSubmittedFrameId = m.browser.layerState[0].layer_stereo_immersive.mFrameId;
-      // VRB_LOG("RequestFrame BREAK %llu",  m.browser.layerState[0].layer_stereo_immersive.mFrameId);
+    if (m.IsFrameReady()) {
+      // VRB_LOG("RequestFrame BREAK %llu",  m.ImmersiveLayer().mFrameId);
       break;
     }
     if (m.firstPresentingFrame) {
       return true; // Do not block to show loading screen until the first frame arrives.
     }
-    // VRB_LOG("RequestFrame ABOUT TO WAIT FOR FRAME %llu %llu",m.browser.layerState[0].layer_stereo_immersive.mFrameId, m.lastFrameId);
-    const float kConditionTimeout = 0.1f;
-    // Wait causes the current thread to block until the condition variable is notified or the timeout happens.
+    // VRB_LOG("RequestFrame ABOUT TO WAIT FOR FRAME %llu %llu",m.ImmersiveLayer().mFrameId, m.lastFrameId);
+    // Wait causes the current thread to block until the condition variable is notified or the deadline passes.
     // Waiting for the condition variable releases the mutex atomically. So GV can modify the browser data.
-    if (!wait.DoWait(kConditionTimeout)) {
+    if (!wait.DoWait(deadline)) {
+      m.MissFrame();
       return false;
     }
     // VRB_LOG("RequestFrame DONE TO WAIT FOR FRAME");
@@ -406,7 +835,7 @@ ExternalVR::WaitFrameResult() {
     // browserMutex lock is reacquired again after the condition variable wait exits.
     m.PullBrowserStateWhileLocked();
   }
-  m.lastFrameId = m.browser.layerState[0].layer_stereo_immersive.mFrameId;
+  m.AcceptFrame();
   return true;
 }
 
@@ -414,21 +843,77 @@ void
 ExternalVR::CompleteEnumeration()
 {
   m.system.enumerationCompleted = true;
+  m.dirty |= kDirtyDisplay;
 }
 
 
 void
 ExternalVR::GetFrameResult(int32_t& aSurfaceHandle, device::EyeRect& aLeftEye, device::EyeRect& aRightEye) const {
-  aSurfaceHandle = (int32_t)m.browser.layerState[0].layer_stereo_immersive.mTextureHandle;
-  mozilla::gfx::VRLayerEyeRect& left = m.browser.layerState[0].layer_stereo_immersive.mLeftEyeRect;
-  mozilla::gfx::VRLayerEyeRect& right = m.browser.layerState[0].layer_stereo_immersive.mRightEyeRect;
+  aSurfaceHandle = (int32_t)m.ImmersiveLayer().mTextureHandle;
+  const mozilla::gfx::VRLayerEyeRect& left = m.ImmersiveLayer().mLeftEyeRect;
+  const mozilla::gfx::VRLayerEyeRect& right = m.ImmersiveLayer().mRightEyeRect;
   aLeftEye = device::EyeRect(left.x, left.y, left.width, left.height);
   aRightEye = device::EyeRect(right.x, right.y, right.width, right.height);
 }
 
+void
+ExternalVR::GetContentLayers(std::vector<ContentLayer>& aLayers) const {
+  aLayers.clear();
+  for (int32_t index = 0; index < mozilla::gfx::kVRLayerMaxCount; index++) {
+    const mozilla::gfx::VRLayerState& layer = m.browser.layerState[index];
+    if (layer.type != mozilla::gfx::VRLayerType::LayerType_2D_Content ||
+        layer.layer_2d_content.mTextureType != mozilla::gfx::VRLayerTextureType::LayerTextureType_GeckoSurfaceTexture) {
+      continue;
+    }
+    ContentLayer content;
+    content.surfaceHandle = (int32_t)layer.layer_2d_content.mTextureHandle;
+    content.frameId = layer.layer_2d_content.mFrameId;
+    aLayers.push_back(content);
+  }
+}
+
+void
+ExternalVR::GetEyeResolution(int32_t& aWidth, int32_t& aHeight) const {
+  aWidth = m.system.displayState.mEyeResolution.width;
+  aHeight = m.system.displayState.mEyeResolution.height;
+}
+
+void
+ExternalVR::GetFrameHandoffStats(uint32_t& aPresentedFrames, uint32_t& aMissedDeadlines) const {
+  aPresentedFrames = m.presentedFrames;
+  aMissedDeadlines = m.missedDeadlines;
+}
+
+void
+ExternalVR::RecordBlitTime(const double aSeconds) {
+  m.blitTime = m.blitTime > 0.0 ? m.blitTime + kLatencySmoothing * (aSeconds - m.blitTime) : aSeconds;
+  m.telemetry->AddSample(TelemetryMetric::Blit, int64_t(aSeconds * SecondsToMicroseconds));
+}
+
+void
+ExternalVR::GetFrameLatency(uint64_t& aInputFrameId, double& aLatency) const {
+  aInputFrameId = m.frameInputId;
+  aLatency = m.frameLatency;
+}
+
+bool
+ExternalVR::GetFrameHeadTransform(vrb::Matrix& aHeadTransform) const {
+  if (!m.frameHeadKnown) {
+    return false;
+  }
+  aHeadTransform = State::PoseTransform(m.frameHead);
+  return true;
+}
+
+const ImmersiveTelemetryPtr&
+ExternalVR::GetTelemetry() const {
+  return m.telemetry;
+}
+
 void
 ExternalVR::StopPresenting() {
   m.system.displayState.mPresentingGeneration++;
+  m.dirty |= kDirtyDisplay;
   PushSystemState();
   m.waitingForExit = true;
 }
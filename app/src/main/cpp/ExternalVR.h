@@ -18,6 +18,9 @@ namespace mozilla { namespace gfx { struct VRExternalShmem; } }
 
 namespace crow {
 
+class ImmersiveTelemetry;
+typedef std::shared_ptr<ImmersiveTelemetry> ImmersiveTelemetryPtr;
+
 class ExternalVR;
 typedef std::shared_ptr<ExternalVR> ExternalVRPtr;
 
@@ -29,6 +32,11 @@ public:
     LinkTraversal,
     Rendering
   };
+  // A 2D layer submitted by content in addition to the stereo projection layer.
+  struct ContentLayer {
+    int32_t surfaceHandle;
+    uint64_t frameId;
+  };
   static ExternalVRPtr Create();
   mozilla::gfx::VRExternalShmem* GetSharedData();
   // DeviceDisplay interface
@@ -47,8 +55,32 @@ public:
   void SetCompositorEnabled(bool aEnabled);
   bool IsPresenting() const;
   VRState GetVRState() const;
-  void PushFramePoses(const vrb::Matrix& aHeadTransform, const std::vector<Controller>& aControllers);
-  bool WaitFrameResult();
+  // Poses are extrapolated past aPredictedDisplayTime by the measured content latency.
+  // Only the controller state flagged in Controller::immersiveDirty is rewritten,
+  // and the flags are cleared once published.
+  void PushFramePoses(const vrb::Matrix& aHeadTransform, std::vector<Controller>& aControllers,
+                      const double aPredictedDisplayTime);
+  // Waits for Gecko to submit a new frame. aPredictedDisplayTime is the device's
+  // predicted display time in CLOCK_MONOTONIC seconds, or zero if unknown. Returns
+  // false if no new frame arrived in time, in which case the last frame should be
+  // presented again.
+  bool WaitFrameResult(const double aPredictedDisplayTime);
+  // Time spent copying the last frame into the eye buffers. Later frames have to be
+  // ready this much earlier.
+  void RecordBlitTime(const double aSeconds);
+  // Counts for the current or most recent immersive session.
+  void GetFrameHandoffStats(uint32_t& aPresentedFrames, uint32_t& aMissedDeadlines) const;
+  // The inputFrameID of the pose used by the last accepted frame and the time in seconds
+  // between publishing that pose and the frame arriving.
+  void GetFrameLatency(uint64_t& aInputFrameId, double& aLatency) const;
+  // The head pose content rendered the last accepted frame with. Returns false if
+  // that pose is no longer in the history.
+  bool GetFrameHeadTransform(vrb::Matrix& aHeadTransform) const;
+  // Performance of the current or most recent immersive session.
+  const ImmersiveTelemetryPtr& GetTelemetry() const;
+  // The 2D content layers of the current frame, back to front.
+  void GetContentLayers(std::vector<ContentLayer>& aLayers) const;
+  void GetEyeResolution(int32_t& aWidth, int32_t& aHeight) const;
   void GetFrameResult(int32_t& aSurfaceHandle, device::EyeRect& aLeftEye, device::EyeRect& aRightEye) const;
   void StopPresenting();
   ~ExternalVR();
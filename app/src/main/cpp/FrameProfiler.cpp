@@ -0,0 +1,182 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "FrameProfiler.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+const uint32_t kMaxFrames = 512;
+const float kNanosecondsToMilliseconds = 1e-6f;
+
+const char* kPhaseNames[crow::FramePhaseCount] = {
+  "ProcessEvents",
+  "ContextUpdate",
+  "Tasks",
+  "PullBrowserState",
+  "UpdateControllers",
+  "TransparentSort",
+  "Cull",
+  "DrawLeftEye",
+  "DrawRightEye",
+  "EndFrame",
+  "AudioPose",
+  "Total"
+};
+
+struct FrameSample {
+  int64_t phases[crow::FramePhaseCount];
+};
+
+} // namespace
+
+namespace crow {
+
+const char*
+FramePhaseName(const FramePhase aPhase) {
+  return kPhaseNames[FramePhaseIndex(aPhase)];
+}
+
+struct FrameProfiler::State {
+  FrameSample frames[kMaxFrames];
+  std::atomic<uint32_t> frameCount;
+  FrameSample current;
+  int64_t frameStart;
+
+  State() : frameCount(0), frameStart(0) {
+    memset(frames, 0, sizeof(frames));
+    memset(&current, 0, sizeof(current));
+  }
+
+  // The render thread may be writing the slot after the newest completed frame,
+  // so readers only look at the kMaxFrames - 1 frames before it.
+  uint32_t ReadableFrames(uint32_t& aFirst) const {
+    const uint32_t count = frameCount.load(std::memory_order_acquire);
+    const uint32_t available = std::min(count, kMaxFrames - 1);
+    aFirst = count - available;
+    return available;
+  }
+};
+
+FrameProfiler::Scope::Scope(FrameProfiler& aProfiler, const FramePhase aPhase)
+    : mProfiler(aProfiler)
+    , mPhase(aPhase)
+    , mStart(FrameProfiler::Now())
+{}
+
+FrameProfiler::Scope::~Scope() {
+  mProfiler.AddSample(mPhase, FrameProfiler::Now() - mStart);
+}
+
+FrameProfilerPtr
+FrameProfiler::Create() {
+  return std::make_shared<vrb::ConcreteClass<FrameProfiler, FrameProfiler::State> >();
+}
+
+int64_t
+FrameProfiler::Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + (int64_t)ts.tv_nsec;
+}
+
+void
+FrameProfiler::StartFrame() {
+  memset(&m.current, 0, sizeof(m.current));
+  m.frameStart = Now();
+}
+
+void
+FrameProfiler::AddSample(const FramePhase aPhase, const int64_t aNanoseconds) {
+  m.current.phases[FramePhaseIndex(aPhase)] += aNanoseconds;
+}
+
+void
+FrameProfiler::EndFrame() {
+  if (m.frameStart == 0) {
+    return;
+  }
+  m.current.phases[FramePhaseIndex(FramePhase::Total)] = Now() - m.frameStart;
+  m.frameStart = 0;
+  const uint32_t count = m.frameCount.load(std::memory_order_relaxed);
+  m.frames[count % kMaxFrames] = m.current;
+  m.frameCount.store(count + 1, std::memory_order_release);
+}
+
+int32_t
+FrameProfiler::GetStats(PhaseStats aStats[FramePhaseCount]) const {
+  uint32_t first = 0;
+  const uint32_t available = m.ReadableFrames(first);
+  for (int32_t phase = 0; phase < FramePhaseCount; phase++) {
+    aStats[phase] = PhaseStats();
+  }
+  if (available == 0) {
+    return 0;
+  }
+
+  std::vector<int64_t> samples(available);
+  for (int32_t phase = 0; phase < FramePhaseCount; phase++) {
+    int64_t total = 0;
+    for (uint32_t index = 0; index < available; index++) {
+      samples[index] = m.frames[(first + index) % kMaxFrames].phases[phase];
+      total += samples[index];
+    }
+    std::sort(samples.begin(), samples.end());
+    const uint32_t p99Index = std::min(available - 1, (available * 99) / 100);
+    aStats[phase].min = samples.front() * kNanosecondsToMilliseconds;
+    aStats[phase].average = (float(total) / float(available)) * kNanosecondsToMilliseconds;
+    aStats[phase].p99 = samples[p99Index] * kNanosecondsToMilliseconds;
+  }
+  return (int32_t)available;
+}
+
+bool
+FrameProfiler::DumpToFile(const std::string& aPath) const {
+  std::ofstream output(aPath, std::ios::out | std::ios::trunc);
+  if (!output) {
+    VRB_ERROR("Unable to open frame timing dump: %s", aPath.c_str());
+    return false;
+  }
+
+  PhaseStats stats[FramePhaseCount];
+  const int32_t frames = GetStats(stats);
+  output << "# " << frames << " frames, times in milliseconds" << std::endl;
+  output << "phase,min,avg,p99" << std::endl;
+  for (int32_t phase = 0; phase < FramePhaseCount; phase++) {
+    output << kPhaseNames[phase] << "," << stats[phase].min << "," << stats[phase].average
+           << "," << stats[phase].p99 << std::endl;
+  }
+
+  output << std::endl << "frame";
+  for (int32_t phase = 0; phase < FramePhaseCount; phase++) {
+    output << "," << kPhaseNames[phase];
+  }
+  output << std::endl;
+  uint32_t first = 0;
+  const uint32_t available = m.ReadableFrames(first);
+  for (uint32_t index = 0; index < available; index++) {
+    const FrameSample& frame = m.frames[(first + index) % kMaxFrames];
+    output << (first + index);
+    for (int32_t phase = 0; phase < FramePhaseCount; phase++) {
+      output << "," << frame.phases[phase] * kNanosecondsToMilliseconds;
+    }
+    output << std::endl;
+  }
+  VRB_LOG("Dumped %u frame timings to: %s", available, aPath.c_str());
+  return output.good();
+}
+
+FrameProfiler::FrameProfiler(State& aState) : m(aState) {}
+FrameProfiler::~FrameProfiler() {}
+
+} // namespace crow
@@ -0,0 +1,81 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_FRAMEPROFILER_H
+#define VRBROWSER_FRAMEPROFILER_H
+
+#include "vrb/MacroUtils.h"
+#include <memory>
+#include <string>
+
+namespace crow {
+
+enum class FramePhase {
+  ProcessEvents,
+  ContextUpdate,
+  Tasks,
+  PullBrowserState,
+  UpdateControllers,
+  TransparentSort,
+  Cull,
+  DrawLeftEye,
+  DrawRightEye,
+  EndFrame,
+  AudioPose,
+  Total
+};
+const int32_t FramePhaseCount = 12;
+inline int32_t FramePhaseIndex(const FramePhase aPhase) { return static_cast<int32_t>(aPhase); }
+const char* FramePhaseName(const FramePhase aPhase);
+
+class FrameProfiler;
+typedef std::shared_ptr<FrameProfiler> FrameProfilerPtr;
+
+// Records how long each phase of a frame takes. Samples are written by the render
+// thread into a fixed size ring so recording never allocates or locks. Statistics
+// may be queried from any thread.
+class FrameProfiler {
+public:
+  struct PhaseStats {
+    float min;
+    float average;
+    float p99;
+    PhaseStats() : min(0.0f), average(0.0f), p99(0.0f) {}
+  };
+
+  class Scope {
+  public:
+    Scope(FrameProfiler& aProfiler, const FramePhase aPhase);
+    ~Scope();
+  private:
+    FrameProfiler& mProfiler;
+    const FramePhase mPhase;
+    const int64_t mStart;
+    Scope() = delete;
+    VRB_NO_DEFAULTS(Scope)
+    VRB_NO_NEW_DELETE
+  };
+
+  static FrameProfilerPtr Create();
+  static int64_t Now();
+  void StartFrame();
+  void AddSample(const FramePhase aPhase, const int64_t aNanoseconds);
+  void EndFrame();
+  // Times are reported in milliseconds over the frames currently held in the ring.
+  int32_t GetStats(PhaseStats aStats[FramePhaseCount]) const;
+  bool DumpToFile(const std::string& aPath) const;
+protected:
+  struct State;
+  FrameProfiler(State& aState);
+  ~FrameProfiler();
+private:
+  State& m;
+  FrameProfiler() = delete;
+  VRB_NO_DEFAULTS(FrameProfiler)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_FRAMEPROFILER_H
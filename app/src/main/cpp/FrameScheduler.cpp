@@ -0,0 +1,84 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "FrameScheduler.h"
+#include "FrameProfiler.h"
+#include "vrb/ConcreteClass.h"
+
+#include <deque>
+
+namespace {
+
+// Leaves most of a 72 Hz frame (13.9 ms) for drawing.
+const int64_t kFrameBudget = 2000000;
+const int32_t kPriorityCount = 3;
+
+} // namespace
+
+namespace crow {
+
+struct FrameScheduler::State {
+  std::deque<FrameTask> queues[kPriorityCount];
+
+  State() {}
+
+  std::deque<FrameTask>* NextQueue() {
+    for (std::deque<FrameTask>& queue: queues) {
+      if (!queue.empty()) {
+        return &queue;
+      }
+    }
+    return nullptr;
+  }
+};
+
+FrameSchedulerPtr
+FrameScheduler::Create() {
+  return std::make_shared<vrb::ConcreteClass<FrameScheduler, FrameScheduler::State> >();
+}
+
+void
+FrameScheduler::Queue(const TaskPriority aPriority, const FrameTask& aTask) {
+  if (aTask) {
+    m.queues[static_cast<int32_t>(aPriority)].push_back(aTask);
+  }
+}
+
+int32_t
+FrameScheduler::Run() {
+  // Tasks that are not finished roll over to the next frame instead of running
+  // again in this one.
+  std::deque<FrameTask> unfinished[kPriorityCount];
+  const int64_t start = FrameProfiler::Now();
+  int32_t count = 0;
+  std::deque<FrameTask>* queue = m.NextQueue();
+  while (queue && (count == 0 || (FrameProfiler::Now() - start) < kFrameBudget)) {
+    FrameTask task = queue->front();
+    queue->pop_front();
+    count++;
+    if (!task()) {
+      unfinished[queue - m.queues].push_back(task);
+    }
+    queue = m.NextQueue();
+  }
+
+  for (int32_t priority = 0; priority < kPriorityCount; priority++) {
+    std::deque<FrameTask>& pending = m.queues[priority];
+    pending.insert(pending.begin(), unfinished[priority].begin(), unfinished[priority].end());
+  }
+  return count;
+}
+
+void
+FrameScheduler::Clear() {
+  for (std::deque<FrameTask>& queue: m.queues) {
+    queue.clear();
+  }
+}
+
+FrameScheduler::FrameScheduler(State& aState) : m(aState) {}
+FrameScheduler::~FrameScheduler() {}
+
+} // namespace crow
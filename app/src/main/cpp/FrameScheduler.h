@@ -0,0 +1,51 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_FRAMESCHEDULER_H
+#define VRBROWSER_FRAMESCHEDULER_H
+
+#include "vrb/MacroUtils.h"
+#include <functional>
+#include <memory>
+
+namespace crow {
+
+enum class TaskPriority {
+  High,
+  Normal,
+  Low
+};
+
+// Returns true once the task has finished. Unfinished tasks run again next frame.
+typedef std::function<bool()> FrameTask;
+
+class FrameScheduler;
+typedef std::shared_ptr<FrameScheduler> FrameSchedulerPtr;
+
+// Runs deferred render thread work in per-frame time slices so expensive loads do
+// not all land in the same frame. Tasks run in priority order, first in first out
+// within a priority. At least one task runs every frame so work always progresses,
+// then tasks keep running until the frame budget is spent.
+class FrameScheduler {
+public:
+  static FrameSchedulerPtr Create();
+  void Queue(const TaskPriority aPriority, const FrameTask& aTask);
+  // Render thread only. Returns the number of tasks run.
+  int32_t Run();
+  // Drops every queued task, including unfinished ones.
+  void Clear();
+protected:
+  struct State;
+  FrameScheduler(State& aState);
+  ~FrameScheduler();
+private:
+  State& m;
+  FrameScheduler() = delete;
+  VRB_NO_DEFAULTS(FrameScheduler)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_FRAMESCHEDULER_H
@@ -0,0 +1,225 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "GLStateCache.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/GLError.h"
+
+#include <atomic>
+
+namespace {
+
+enum class Tristate : uint8_t {
+  Unknown,
+  Off,
+  On
+};
+
+const GLenum kCapabilities[] = {
+  GL_BLEND,
+  GL_CULL_FACE,
+  GL_DEPTH_TEST,
+  GL_POLYGON_OFFSET_FILL,
+  GL_SCISSOR_TEST,
+  GL_STENCIL_TEST
+};
+const int32_t kCapabilityCount = sizeof(kCapabilities) / sizeof(kCapabilities[0]);
+
+int32_t
+CapabilityIndex(const GLenum aCapability) {
+  for (int32_t index = 0; index < kCapabilityCount; index++) {
+    if (kCapabilities[index] == aCapability) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+} // namespace
+
+namespace crow {
+
+struct GLStateCache::State {
+  Tristate capabilities[kCapabilityCount];
+  Tristate depthMask;
+  bool blendFuncKnown;
+  GLenum blendSource;
+  GLenum blendDestination;
+  bool clearColorKnown;
+  GLfloat clearColor[4];
+  bool programKnown;
+  GLuint program;
+  uint64_t issued;
+  uint64_t elided;
+  std::atomic<uint64_t> frameIssued;
+  std::atomic<uint64_t> frameElided;
+  std::atomic<uint64_t> totalIssued;
+  std::atomic<uint64_t> totalElided;
+
+  State()
+      : issued(0)
+      , elided(0)
+      , frameIssued(0)
+      , frameElided(0)
+      , totalIssued(0)
+      , totalElided(0)
+  {
+    Forget();
+  }
+
+  void Forget() {
+    for (Tristate& capability: capabilities) {
+      capability = Tristate::Unknown;
+    }
+    depthMask = Tristate::Unknown;
+    blendFuncKnown = false;
+    blendSource = GL_ONE;
+    blendDestination = GL_ZERO;
+    clearColorKnown = false;
+    for (GLfloat& channel: clearColor) {
+      channel = 0.0f;
+    }
+    programKnown = false;
+    program = 0;
+  }
+
+  // Returns true if the call has to be issued.
+  bool Change(const bool aNeeded) {
+    if (aNeeded) {
+      issued++;
+    } else {
+      elided++;
+    }
+    return aNeeded;
+  }
+
+  void SetCapability(const GLenum aCapability, const bool aEnabled) {
+    const int32_t index = CapabilityIndex(aCapability);
+    const Tristate value = aEnabled ? Tristate::On : Tristate::Off;
+    if (!Change(index < 0 || capabilities[index] != value)) {
+      return;
+    }
+    if (aEnabled) {
+      VRB_GL_CHECK(glEnable(aCapability));
+    } else {
+      VRB_GL_CHECK(glDisable(aCapability));
+    }
+    if (index >= 0) {
+      capabilities[index] = value;
+    }
+  }
+};
+
+GLStateCache&
+GLStateCache::Instance() {
+  static vrb::ConcreteClass<GLStateCache, GLStateCache::State> sInstance;
+  return sInstance;
+}
+
+void
+GLStateCache::StartFrame() {
+  m.frameIssued.store(m.issued, std::memory_order_relaxed);
+  m.frameElided.store(m.elided, std::memory_order_relaxed);
+  m.totalIssued.fetch_add(m.issued, std::memory_order_relaxed);
+  m.totalElided.fetch_add(m.elided, std::memory_order_relaxed);
+  m.issued = 0;
+  m.elided = 0;
+  m.programKnown = false;
+}
+
+void
+GLStateCache::Invalidate() {
+  m.Forget();
+}
+
+void
+GLStateCache::Enable(const GLenum aCapability) {
+  m.SetCapability(aCapability, true);
+}
+
+void
+GLStateCache::Disable(const GLenum aCapability) {
+  m.SetCapability(aCapability, false);
+}
+
+bool
+GLStateCache::IsEnabled(const GLenum aCapability) {
+  const int32_t index = CapabilityIndex(aCapability);
+  if (index >= 0 && m.capabilities[index] != Tristate::Unknown) {
+    m.elided++;
+    return m.capabilities[index] == Tristate::On;
+  }
+  m.issued++;
+  const bool result = glIsEnabled(aCapability) == GL_TRUE;
+  if (index >= 0) {
+    m.capabilities[index] = result ? Tristate::On : Tristate::Off;
+  }
+  return result;
+}
+
+void
+GLStateCache::DepthMask(const GLboolean aFlag) {
+  const Tristate value = aFlag ? Tristate::On : Tristate::Off;
+  if (m.Change(m.depthMask != value)) {
+    VRB_GL_CHECK(glDepthMask(aFlag));
+    m.depthMask = value;
+  }
+}
+
+void
+GLStateCache::BlendFunc(const GLenum aSourceFactor, const GLenum aDestinationFactor) {
+  if (m.Change(!m.blendFuncKnown || m.blendSource != aSourceFactor || m.blendDestination != aDestinationFactor)) {
+    VRB_GL_CHECK(glBlendFunc(aSourceFactor, aDestinationFactor));
+    m.blendFuncKnown = true;
+    m.blendSource = aSourceFactor;
+    m.blendDestination = aDestinationFactor;
+  }
+}
+
+void
+GLStateCache::ClearColor(const GLfloat aRed, const GLfloat aGreen, const GLfloat aBlue, const GLfloat aAlpha) {
+  const GLfloat color[4] = {aRed, aGreen, aBlue, aAlpha};
+  bool changed = !m.clearColorKnown;
+  for (int32_t channel = 0; channel < 4 && !changed; channel++) {
+    changed = m.clearColor[channel] != color[channel];
+  }
+  if (m.Change(changed)) {
+    VRB_GL_CHECK(glClearColor(aRed, aGreen, aBlue, aAlpha));
+    m.clearColorKnown = true;
+    for (int32_t channel = 0; channel < 4; channel++) {
+      m.clearColor[channel] = color[channel];
+    }
+  }
+}
+
+void
+GLStateCache::UseProgram(const GLuint aProgram) {
+  if (m.Change(!m.programKnown || m.program != aProgram)) {
+    VRB_GL_CHECK(glUseProgram(aProgram));
+    m.programKnown = true;
+    m.program = aProgram;
+  }
+}
+
+GLStateCache::Counters
+GLStateCache::GetFrameCounters() const {
+  Counters result;
+  result.issued = m.frameIssued.load(std::memory_order_relaxed);
+  result.elided = m.frameElided.load(std::memory_order_relaxed);
+  return result;
+}
+
+GLStateCache::Counters
+GLStateCache::GetTotalCounters() const {
+  Counters result;
+  result.issued = m.totalIssued.load(std::memory_order_relaxed);
+  result.elided = m.totalElided.load(std::memory_order_relaxed);
+  return result;
+}
+
+GLStateCache::GLStateCache(State& aState) : m(aState) {}
+GLStateCache::~GLStateCache() {}
+
+} // namespace crow
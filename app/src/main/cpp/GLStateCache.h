@@ -0,0 +1,54 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_GLSTATECACHE_H
+#define VRBROWSER_GLSTATECACHE_H
+
+#include "vrb/gl.h"
+#include "vrb/MacroUtils.h"
+#include <stdint.h>
+
+namespace crow {
+
+// Shadow of the fixed function GL state the browser sets on the render thread. State
+// changes that would not change anything are skipped. vrb binds programs on its own,
+// so the program binding is forgotten at the start of every frame; other state is
+// trusted until Invalidate is called, which code that hands the context to a device
+// SDK compositor must do once it gets it back.
+class GLStateCache {
+public:
+  struct Counters {
+    uint64_t issued;
+    uint64_t elided;
+    Counters() : issued(0), elided(0) {}
+  };
+
+  static GLStateCache& Instance();
+  void StartFrame();
+  void Invalidate();
+  void Enable(const GLenum aCapability);
+  void Disable(const GLenum aCapability);
+  // Answered from the shadow when it is known, otherwise queried once.
+  bool IsEnabled(const GLenum aCapability);
+  void DepthMask(const GLboolean aFlag);
+  void BlendFunc(const GLenum aSourceFactor, const GLenum aDestinationFactor);
+  void ClearColor(const GLfloat aRed, const GLfloat aGreen, const GLfloat aBlue, const GLfloat aAlpha);
+  void UseProgram(const GLuint aProgram);
+  // Counters of the last completed frame and since startup. Safe to call from any thread.
+  Counters GetFrameCounters() const;
+  Counters GetTotalCounters() const;
+protected:
+  struct State;
+  GLStateCache(State& aState);
+  ~GLStateCache();
+private:
+  State& m;
+  GLStateCache() = delete;
+  VRB_NO_DEFAULTS(GLStateCache)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_GLSTATECACHE_H
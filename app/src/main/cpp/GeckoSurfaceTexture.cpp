@@ -7,10 +7,17 @@
 #include <vrb/include/vrb/GLError.h>
 #include "GeckoSurfaceTexture.h"
 #include "JNIUtil.h"
+#include "SurfaceLatch.h"
 
 #include "vrb/ClassLoaderAndroid.h"
 #include "vrb/Logger.h"
 
+#include <dlfcn.h>
+#include <unordered_set>
+
+// From android/surface_texture_jni.h, which is only available from API level 28.
+struct ASurfaceTexture;
+
 namespace {
 
 static vrb::ClassLoaderAndroidPtr sClassLoader;
@@ -25,6 +32,7 @@ static jmethodID sUpdateTexImage;
 static jmethodID sReleaseTexImage;
 static jmethodID sIncrementUse;
 static jmethodID sDecrementUse;
+static jfieldID sListener;
 
 static const char* kClassName = "org/mozilla/gecko/gfx/GeckoSurfaceTexture";
 static const char* kLookupName = "lookup";
@@ -43,6 +51,160 @@ static const char* kIncrementUseName = "incrementUse";
 static const char* kIncrementUseSignature = "()V";
 static const char* kDecrementUseName = "decrementUse";
 static const char* kDecrementUseSignature = "()V";
+static const char* kListenerName = "mListener";
+static const char* kListenerSignature = "Lorg/mozilla/gecko/gfx/GeckoSurfaceTexture$Callbacks;";
+
+typedef ASurfaceTexture* (*FromSurfaceTextureFn)(JNIEnv*, jobject);
+typedef void (*ReleaseSurfaceTextureFn)(ASurfaceTexture*);
+typedef int (*UpdateTexImageFn)(ASurfaceTexture*);
+class NativeSurfaceSource;
+static std::unordered_set<NativeSurfaceSource*> sNativeSources;
+static void* sAndroidLibrary;
+static FromSurfaceTextureFn sFromSurfaceTexture;
+static ReleaseSurfaceTextureFn sReleaseSurfaceTexture;
+static UpdateTexImageFn sUpdateTexImageNative;
+
+void
+LoadNativeSurfaceTexture() {
+  sAndroidLibrary = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+  if (!sAndroidLibrary) {
+    return;
+  }
+  sFromSurfaceTexture = (FromSurfaceTextureFn)dlsym(sAndroidLibrary, "ASurfaceTexture_fromSurfaceTexture");
+  sReleaseSurfaceTexture = (ReleaseSurfaceTextureFn)dlsym(sAndroidLibrary, "ASurfaceTexture_release");
+  sUpdateTexImageNative = (UpdateTexImageFn)dlsym(sAndroidLibrary, "ASurfaceTexture_updateTexImage");
+  if (!sFromSurfaceTexture || !sReleaseSurfaceTexture || !sUpdateTexImageNative) {
+    VRB_LOG("ASurfaceTexture not available, GeckoSurfaceTexture frames will be latched through JNI");
+    sFromSurfaceTexture = nullptr;
+    sReleaseSurfaceTexture = nullptr;
+    sUpdateTexImageNative = nullptr;
+  }
+}
+
+void ReleaseNativeSources();
+
+void
+UnloadNativeSurfaceTexture() {
+  // Pooled surfaces may outlive Java, their handles must not outlive the library.
+  ReleaseNativeSources();
+  sFromSurfaceTexture = nullptr;
+  sReleaseSurfaceTexture = nullptr;
+  sUpdateTexImageNative = nullptr;
+  if (sAndroidLibrary) {
+    dlclose(sAndroidLibrary);
+    sAndroidLibrary = nullptr;
+  }
+}
+
+// Every call goes through the Java GeckoSurfaceTexture. Updating a detached
+// SurfaceTexture is not reported, so the attachment is queried every frame.
+class JNISurfaceSource : public crow::SurfaceSource {
+public:
+  JNISurfaceSource(jobject aSurface) : mSurface(aSurface) {}
+
+  bool IsAttached(void* aContext) override {
+    if (!crow::ValidateMethodID(sEnv, mSurface, sIsAttachedToGLContext, __FUNCTION__)) { return false; }
+    bool result = sEnv->CallBooleanMethod(mSurface, sIsAttachedToGLContext, (jlong)aContext);
+    crow::CheckJNIException(sEnv, __FUNCTION__);
+    return result;
+  }
+
+  bool Attach(void* aContext, const uint32_t aTexture) override {
+    if (!crow::ValidateMethodID(sEnv, mSurface, sAttachToGLContext, __FUNCTION__)) { return false; }
+    sEnv->CallVoidMethod(mSurface, sAttachToGLContext, (jlong)aContext, (jint)aTexture);
+    return !HasException(__FUNCTION__);
+  }
+
+  void Detach() override {
+    if (!crow::ValidateMethodID(sEnv, mSurface, sDetachFromGLContext, __FUNCTION__)) { return; }
+    sEnv->CallVoidMethod(mSurface, sDetachFromGLContext);
+    crow::CheckJNIException(sEnv, __FUNCTION__);
+  }
+
+  UpdateResult Update() override {
+    if (!crow::ValidateMethodID(sEnv, mSurface, sUpdateTexImage, __FUNCTION__)) { return UpdateResult::Failed; }
+    sEnv->CallVoidMethod(mSurface, sUpdateTexImage);
+    return HasException(__FUNCTION__) ? UpdateResult::Failed : UpdateResult::Latched;
+  }
+
+  void Release() override {
+    if (!crow::ValidateMethodID(sEnv, mSurface, sReleaseTexImage, __FUNCTION__)) { return; }
+    sEnv->CallVoidMethod(mSurface, sReleaseTexImage);
+    crow::CheckJNIException(sEnv, __FUNCTION__);
+  }
+
+  bool DetectsDetach() const override { return false; }
+
+protected:
+  bool HasException(const char* aName) {
+    const bool result = sEnv->ExceptionCheck() == JNI_TRUE;
+    crow::CheckJNIException(sEnv, aName);
+    return result;
+  }
+
+  jobject mSurface;
+};
+
+// Frames are latched with ASurfaceTexture_updateTexImage, which reuses the EGLImage
+// the consumer created for each producer buffer and waits on the buffer's fence
+// without leaving native code. It fails when the surface is not attached to the
+// current context, so the attachment only needs to be queried when that happens.
+// Attaching, detaching and releasing still go through Java so GeckoView's
+// bookkeeping of the SurfaceTexture stays correct. The Java updateTexImage is
+// synchronized and notifies the surface's listener, so the native update holds the
+// same monitor and is only used while no listener is set.
+class NativeSurfaceSource : public JNISurfaceSource {
+public:
+  NativeSurfaceSource(jobject aSurface, ASurfaceTexture* aNative)
+      : JNISurfaceSource(aSurface), mNative(aNative) {
+    sNativeSources.insert(this);
+  }
+  ~NativeSurfaceSource() {
+    ReleaseNative();
+    sNativeSources.erase(this);
+  }
+
+  // Later updates go through Java.
+  void ReleaseNative() {
+    if (mNative && sReleaseSurfaceTexture) {
+      sReleaseSurfaceTexture(mNative);
+    }
+    mNative = nullptr;
+  }
+
+  UpdateResult Update() override {
+    if (!mNative || HasListener()) {
+      return JNISurfaceSource::Update();
+    }
+    if (sEnv->MonitorEnter(mSurface) != JNI_OK) {
+      return JNISurfaceSource::Update();
+    }
+    const int result = sUpdateTexImageNative(mNative);
+    sEnv->MonitorExit(mSurface);
+    return result == 0 ? UpdateResult::Latched : UpdateResult::NotAttached;
+  }
+
+  bool DetectsDetach() const override { return mNative != nullptr; }
+
+private:
+  bool HasListener() {
+    jobject listener = sEnv->GetObjectField(mSurface, sListener);
+    if (!listener) {
+      return false;
+    }
+    sEnv->DeleteLocalRef(listener);
+    return true;
+  }
+
+  ASurfaceTexture* mNative;
+};
+
+void
+ReleaseNativeSources() {
+  for (NativeSurfaceSource* source: sNativeSources) {
+    source->ReleaseNative();
+  }
+}
 
 }
 
@@ -51,11 +213,29 @@ namespace crow {
 struct GeckoSurfaceTexture::State {
   jobject surface;
   GLuint texture;
+  SurfaceSourcePtr source;
+  SurfaceLatchPtr latch;
+  bool native;
   State()
-      : surface(nullptr), texture(0)
+      : surface(nullptr), texture(0), native(false)
   {}
   ~State() {}
+
+  void CreateTexture() {
+    if (texture != 0) {
+      return;
+    }
+    VRB_GL_CHECK(glGenTextures(1, &texture));
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  }
+
   void Shutdown() {
+    latch = nullptr;
+    source = nullptr;
     if (surface && sEnv) {
       sEnv->DeleteGlobalRef(surface);
       surface = nullptr;
@@ -92,6 +272,12 @@ GeckoSurfaceTexture::InitializeJava(JNIEnv* aEnv, jobject aActivity) {
   sReleaseTexImage = FindJNIMethodID(sEnv, sGeckoSurfaceTextureClass, kReleaseTexImageName, kReleaseTexImageSignature);
   sIncrementUse = FindJNIMethodID(sEnv, sGeckoSurfaceTextureClass, kIncrementUseName, kIncrementUseSignature);
   sDecrementUse = FindJNIMethodID(sEnv, sGeckoSurfaceTextureClass, kDecrementUseName, kDecrementUseSignature);
+  // Without access to the listener frames can not be latched natively.
+  sListener = sEnv->GetFieldID(sGeckoSurfaceTextureClass, kListenerName, kListenerSignature);
+  CheckJNIException(sEnv, __FUNCTION__);
+  if (sListener) {
+    LoadNativeSurfaceTexture();
+  }
 }
 
 void
@@ -115,6 +301,8 @@ GeckoSurfaceTexture::ShutdownJava() {
     sUpdateTexImage = nullptr;
     sIncrementUse = nullptr;
     sDecrementUse = nullptr;
+    sListener = nullptr;
+    UnloadNativeSurfaceTexture();
     sEnv = nullptr;
   }
 }
@@ -137,6 +325,14 @@ GeckoSurfaceTexture::Create(const int32_t aHandle) {
   }
   result = std::make_shared<vrb::ConcreteClass<GeckoSurfaceTexture, GeckoSurfaceTexture::State> >();
   result->m.surface = sEnv->NewGlobalRef(surface);
+  ASurfaceTexture* native = sFromSurfaceTexture ? sFromSurfaceTexture(sEnv, result->m.surface) : nullptr;
+  if (native) {
+    result->m.source = std::make_shared<NativeSurfaceSource>(result->m.surface, native);
+    result->m.native = true;
+  } else {
+    result->m.source = std::make_shared<JNISurfaceSource>(result->m.surface);
+  }
+  result->m.latch = SurfaceLatch::Create(result->m.source);
   result->IncrementUse();
   return result;
 }
@@ -148,46 +344,44 @@ GeckoSurfaceTexture::GetTextureName() {
 
 void
 GeckoSurfaceTexture::AttachToGLContext(EGLContext aContext) {
-  if (!ValidateMethodID(sEnv, m.surface, sAttachToGLContext, __FUNCTION__)) { return; }
-  if (m.texture == 0) {
-    VRB_GL_CHECK(glGenTextures(1, &(m.texture)));
-    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_EXTERNAL_OES, m.texture));
-    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-  }
-  sEnv->CallVoidMethod(m.surface, sAttachToGLContext, (jlong)aContext, (jint)m.texture);
-  CheckJNIException(sEnv, __FUNCTION__);
+  if (!m.source) { return; }
+  m.CreateTexture();
+  m.source->Attach(aContext, m.texture);
 }
 
 bool
 GeckoSurfaceTexture::IsAttachedToGLContext(EGLContext aContext) const {
-  if (!ValidateMethodID(sEnv, m.surface, sIsAttachedToGLContext, __FUNCTION__)) { return false; }
-  bool result = sEnv->CallBooleanMethod(m.surface, sIsAttachedToGLContext, (jlong)aContext);
-  CheckJNIException(sEnv, __FUNCTION__);
-  return result;
+  return m.source && m.source->IsAttached(aContext);
 }
 
 void
 GeckoSurfaceTexture::DetachFromGLContext() {
-  if (!ValidateMethodID(sEnv, m.surface, sDetachFromGLContext, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(m.surface, sDetachFromGLContext);
-  CheckJNIException(sEnv, __FUNCTION__);
+  if (!m.source) { return; }
+  m.source->Detach();
 }
 
 void
 GeckoSurfaceTexture::UpdateTexImage() {
-  if (!ValidateMethodID(sEnv, m.surface, sUpdateTexImage, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(m.surface, sUpdateTexImage);
-  CheckJNIException(sEnv, __FUNCTION__);
+  if (!m.source) { return; }
+  m.source->Update();
+}
+
+bool
+GeckoSurfaceTexture::Latch(EGLContext aContext) {
+  if (!m.latch) { return false; }
+  m.CreateTexture();
+  return m.latch->Latch(aContext, m.texture);
 }
 
 void
 GeckoSurfaceTexture::ReleaseTexImage() {
-  if (!ValidateMethodID(sEnv, m.surface, sReleaseTexImage, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(m.surface, sReleaseTexImage);
-  CheckJNIException(sEnv, __FUNCTION__);
+  if (!m.latch) { return; }
+  m.latch->Release();
+}
+
+bool
+GeckoSurfaceTexture::IsNative() const {
+  return m.native;
 }
 
 void
@@ -209,8 +403,8 @@ GeckoSurfaceTexture::~GeckoSurfaceTexture() {
   if (m.surface) {
     VRB_LOG("Destroy GeckoSurfaceTexture");
     ReleaseTexImage();
-    if (IsAttachedToGLContext(eglGetCurrentContext())) {
-      DetachFromGLContext();
+    if (m.latch) {
+      m.latch->Detach(eglGetCurrentContext());
     }
     DecrementUse();
   }
@@ -18,6 +18,9 @@ namespace crow {
 class GeckoSurfaceTexture;
 typedef std::shared_ptr<GeckoSurfaceTexture> GeckoSurfaceTexturePtr;
 
+// Consumes the frames GeckoView renders into a Java GeckoSurfaceTexture. Frames are
+// latched natively through ASurfaceTexture when the platform provides it, and through
+// JNI otherwise.
 class GeckoSurfaceTexture {
 public:
   static void InitializeJava(JNIEnv* aEnv, jobject aActivity);
@@ -28,7 +31,11 @@ public:
   bool IsAttachedToGLContext(EGLContext aContext) const;
   void DetachFromGLContext();
   void UpdateTexImage();
+  // Attaches to aContext if needed and latches the newest frame.
+  bool Latch(EGLContext aContext);
+  // Returns a frame taken with Latch to the producer.
   void ReleaseTexImage();
+  bool IsNative() const;
   void IncrementUse();
   void DecrementUse();
 
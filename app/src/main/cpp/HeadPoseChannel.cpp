@@ -0,0 +1,106 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "HeadPoseChannel.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Quaternion.h"
+#include "vrb/Vector.h"
+
+#include <atomic>
+#include <math.h>
+
+namespace {
+
+const float kDegreesToRadians = (float)M_PI / 180.0f;
+
+} // namespace
+
+namespace crow {
+
+struct HeadPoseChannel::State {
+  std::atomic<uint32_t> sequence;
+  std::atomic<float> values[kValueCount];
+  // Only touched by the render thread.
+  float published[kValueCount];
+  bool hasPublished;
+  float minCosHalfAngle;
+  float minDistanceSquared;
+
+  State() : sequence(0), hasPublished(false), minCosHalfAngle(1.0f), minDistanceSquared(0.0f) {
+    for (int32_t index = 0; index < kValueCount; index++) {
+      values[index].store(0.0f, std::memory_order_relaxed);
+      published[index] = 0.0f;
+    }
+  }
+
+  bool ExceedsThresholds(const float* aPose) const {
+    if (!hasPublished) {
+      return true;
+    }
+    const float dot = fabsf(aPose[0] * published[0] + aPose[1] * published[1] +
+                            aPose[2] * published[2] + aPose[3] * published[3]);
+    const float dx = aPose[4] - published[4];
+    const float dy = aPose[5] - published[5];
+    const float dz = aPose[6] - published[6];
+    const float distanceSquared = dx * dx + dy * dy + dz * dz;
+    return dot < minCosHalfAngle || distanceSquared > minDistanceSquared;
+  }
+};
+
+HeadPoseChannelPtr
+HeadPoseChannel::Create() {
+  return std::make_shared<vrb::ConcreteClass<HeadPoseChannel, HeadPoseChannel::State> >();
+}
+
+void
+HeadPoseChannel::SetThresholds(const float aDegrees, const float aMeters) {
+  m.minCosHalfAngle = cosf(aDegrees * 0.5f * kDegreesToRadians);
+  m.minDistanceSquared = aMeters * aMeters;
+}
+
+bool
+HeadPoseChannel::Publish(const vrb::Quaternion& aRotation, const vrb::Vector& aPosition) {
+  const float pose[kValueCount] = {
+      aRotation.x(), aRotation.y(), aRotation.z(), aRotation.w(),
+      aPosition.x(), aPosition.y(), aPosition.z()
+  };
+  if (!m.ExceedsThresholds(pose)) {
+    return false;
+  }
+
+  // Odd sequence numbers mark a write in progress.
+  const uint32_t sequence = m.sequence.load(std::memory_order_relaxed);
+  m.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (int32_t index = 0; index < kValueCount; index++) {
+    m.values[index].store(pose[index], std::memory_order_relaxed);
+    m.published[index] = pose[index];
+  }
+  m.sequence.store(sequence + 2, std::memory_order_release);
+  m.hasPublished = true;
+  return true;
+}
+
+uint32_t
+HeadPoseChannel::Read(float aValues[kValueCount]) const {
+  while (true) {
+    const uint32_t before = m.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    for (int32_t index = 0; index < kValueCount; index++) {
+      aValues[index] = m.values[index].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m.sequence.load(std::memory_order_relaxed) == before) {
+      return before / 2;
+    }
+  }
+}
+
+HeadPoseChannel::HeadPoseChannel(State& aState) : m(aState) {}
+HeadPoseChannel::~HeadPoseChannel() {}
+
+} // namespace crow
@@ -0,0 +1,47 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_HEADPOSECHANNEL_H
+#define VRBROWSER_HEADPOSECHANNEL_H
+
+#include "vrb/MacroUtils.h"
+#include "vrb/Forward.h"
+#include <memory>
+#include <stdint.h>
+
+namespace crow {
+
+class HeadPoseChannel;
+typedef std::shared_ptr<HeadPoseChannel> HeadPoseChannelPtr;
+
+// Publishes the latest head pose for readers running at their own rate, such as
+// the audio engine. The render thread is the only writer; readers never block it
+// and retry if they race with a write (seqlock).
+class HeadPoseChannel {
+public:
+  // Pose is stored as quaternion x, y, z, w followed by position x, y, z.
+  static const int32_t kValueCount = 7;
+  static HeadPoseChannelPtr Create();
+  // Poses that differ from the last published one by less than both thresholds are
+  // not published. Zero thresholds publish every change.
+  void SetThresholds(const float aDegrees, const float aMeters);
+  // Render thread only. Returns true if the pose was published.
+  bool Publish(const vrb::Quaternion& aRotation, const vrb::Vector& aPosition);
+  // Any thread. Returns the sequence number of the copied pose, which only changes
+  // when a new pose is published. Returns zero if nothing has been published yet.
+  uint32_t Read(float aValues[kValueCount]) const;
+protected:
+  struct State;
+  HeadPoseChannel(State& aState);
+  ~HeadPoseChannel();
+private:
+  State& m;
+  HeadPoseChannel() = delete;
+  VRB_NO_DEFAULTS(HeadPoseChannel)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_HEADPOSECHANNEL_H
@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ImmersiveTelemetry.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+namespace {
+
+const int32_t kSubBucketBits = 3;
+const int64_t kSubBucketCount = 1 << kSubBucketBits;
+
+const char* kMetricNames[crow::TelemetryMetricCount] = {
+  "FrameIdDelta",
+  "FrameWait",
+  "Blit",
+  "PoseLatency"
+};
+
+int32_t
+BucketIndex(const int64_t aValue) {
+  if (aValue < kSubBucketCount) {
+    return (int32_t)std::max(aValue, (int64_t)0);
+  }
+  const int32_t highestBit = 63 - __builtin_clzll((uint64_t)aValue);
+  const int32_t shift = highestBit - kSubBucketBits;
+  const int64_t index = kSubBucketCount + shift * kSubBucketCount + ((aValue >> shift) - kSubBucketCount);
+  return (int32_t)std::min(index, (int64_t)crow::ImmersiveTelemetry::kBucketCount - 1);
+}
+
+} // namespace
+
+namespace crow {
+
+const char*
+TelemetryMetricName(const TelemetryMetric aMetric) {
+  return kMetricNames[TelemetryMetricIndex(aMetric)];
+}
+
+struct ImmersiveTelemetry::State {
+  std::atomic<uint64_t> buckets[TelemetryMetricCount][kBucketCount];
+  std::atomic<int64_t> max[TelemetryMetricCount];
+  std::atomic<uint64_t> skippedFrames;
+  std::atomic<uint64_t> repeatedFrames;
+  uint64_t lastFrameId;
+
+  State() {
+    Reset();
+  }
+
+  void Reset() {
+    for (int32_t metric = 0; metric < TelemetryMetricCount; metric++) {
+      for (std::atomic<uint64_t>& bucket: buckets[metric]) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      max[metric].store(0, std::memory_order_relaxed);
+    }
+    skippedFrames.store(0, std::memory_order_relaxed);
+    repeatedFrames.store(0, std::memory_order_relaxed);
+    lastFrameId = 0;
+  }
+};
+
+int64_t
+ImmersiveTelemetry::BucketLowerBound(const int32_t aBucket) {
+  if (aBucket < kSubBucketCount) {
+    return aBucket;
+  }
+  const int64_t shift = (aBucket - kSubBucketCount) / kSubBucketCount;
+  const int64_t subBucket = (aBucket - kSubBucketCount) % kSubBucketCount;
+  return (kSubBucketCount + subBucket) << shift;
+}
+
+ImmersiveTelemetryPtr
+ImmersiveTelemetry::Create() {
+  return std::make_shared<vrb::ConcreteClass<ImmersiveTelemetry, ImmersiveTelemetry::State> >();
+}
+
+void
+ImmersiveTelemetry::Reset() {
+  m.Reset();
+}
+
+void
+ImmersiveTelemetry::AddSample(const TelemetryMetric aMetric, const int64_t aValue) {
+  const int32_t metric = TelemetryMetricIndex(aMetric);
+  m.buckets[metric][BucketIndex(aValue)].fetch_add(1, std::memory_order_relaxed);
+  // Only the render thread writes, so there is no need for a compare and swap.
+  if (aValue > m.max[metric].load(std::memory_order_relaxed)) {
+    m.max[metric].store(aValue, std::memory_order_relaxed);
+  }
+}
+
+void
+ImmersiveTelemetry::RecordFrameId(const uint64_t aFrameId) {
+  if (m.lastFrameId != 0) {
+    const int64_t delta = (int64_t)(aFrameId - m.lastFrameId);
+    AddSample(TelemetryMetric::FrameIdDelta, delta);
+    if (delta == 0) {
+      m.repeatedFrames.fetch_add(1, std::memory_order_relaxed);
+    } else if (delta > 1) {
+      m.skippedFrames.fetch_add((uint64_t)(delta - 1), std::memory_order_relaxed);
+    }
+  }
+  m.lastFrameId = aFrameId;
+}
+
+uint64_t
+ImmersiveTelemetry::GetSkippedFrames() const {
+  return m.skippedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t
+ImmersiveTelemetry::GetRepeatedFrames() const {
+  return m.repeatedFrames.load(std::memory_order_relaxed);
+}
+
+void
+ImmersiveTelemetry::GetHistogram(const TelemetryMetric aMetric, uint64_t aCounts[kBucketCount]) const {
+  const int32_t metric = TelemetryMetricIndex(aMetric);
+  for (int32_t bucket = 0; bucket < kBucketCount; bucket++) {
+    aCounts[bucket] = m.buckets[metric][bucket].load(std::memory_order_relaxed);
+  }
+}
+
+ImmersiveTelemetry::Summary
+ImmersiveTelemetry::GetSummary(const TelemetryMetric aMetric) const {
+  Summary result;
+  uint64_t counts[kBucketCount];
+  GetHistogram(aMetric, counts);
+  for (uint64_t count: counts) {
+    result.count += count;
+  }
+  result.max = m.max[TelemetryMetricIndex(aMetric)].load(std::memory_order_relaxed);
+  if (result.count == 0) {
+    return result;
+  }
+
+  // Percentiles report the lower bound of the bucket holding them.
+  const uint64_t p50 = (result.count * 50 + 99) / 100;
+  const uint64_t p90 = (result.count * 90 + 99) / 100;
+  const uint64_t p99 = (result.count * 99 + 99) / 100;
+  uint64_t seen = 0;
+  for (int32_t bucket = 0; bucket < kBucketCount; bucket++) {
+    if (counts[bucket] == 0) {
+      continue;
+    }
+    const uint64_t previous = seen;
+    seen += counts[bucket];
+    const int64_t value = BucketLowerBound(bucket);
+    if (previous < p50 && seen >= p50) {
+      result.p50 = value;
+    }
+    if (previous < p90 && seen >= p90) {
+      result.p90 = value;
+    }
+    if (previous < p99 && seen >= p99) {
+      result.p99 = value;
+    }
+  }
+  return result;
+}
+
+bool
+ImmersiveTelemetry::DumpToFile(const std::string& aPath) const {
+  std::ofstream output(aPath, std::ios::out | std::ios::trunc);
+  if (!output) {
+    VRB_ERROR("Unable to open immersive telemetry dump: %s", aPath.c_str());
+    return false;
+  }
+
+  output << "# skipped frames " << GetSkippedFrames() << ", repeated frames " << GetRepeatedFrames()
+         << ", times in microseconds" << std::endl;
+  output << "metric,count,p50,p90,p99,max" << std::endl;
+  for (int32_t metric = 0; metric < TelemetryMetricCount; metric++) {
+    const Summary summary = GetSummary(static_cast<TelemetryMetric>(metric));
+    output << kMetricNames[metric] << "," << summary.count << "," << summary.p50 << "," << summary.p90
+           << "," << summary.p99 << "," << summary.max << std::endl;
+  }
+
+  output << std::endl << "metric,bucket,count" << std::endl;
+  uint64_t counts[kBucketCount];
+  for (int32_t metric = 0; metric < TelemetryMetricCount; metric++) {
+    GetHistogram(static_cast<TelemetryMetric>(metric), counts);
+    for (int32_t bucket = 0; bucket < kBucketCount; bucket++) {
+      if (counts[bucket] > 0) {
+        output << kMetricNames[metric] << "," << BucketLowerBound(bucket) << "," << counts[bucket] << std::endl;
+      }
+    }
+  }
+  VRB_LOG("Dumped immersive telemetry to: %s", aPath.c_str());
+  return output.good();
+}
+
+ImmersiveTelemetry::ImmersiveTelemetry(State& aState) : m(aState) {}
+ImmersiveTelemetry::~ImmersiveTelemetry() {}
+
+} // namespace crow
@@ -0,0 +1,70 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_IMMERSIVETELEMETRY_H
+#define VRBROWSER_IMMERSIVETELEMETRY_H
+
+#include "vrb/MacroUtils.h"
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace crow {
+
+// Values must match the Telemetry* constants in VRBrowserActivity.java.
+enum class TelemetryMetric {
+  FrameIdDelta, // Content frame id advance per presented frame, 0 means repeated.
+  FrameWait,    // Microseconds spent in ExternalVR::WaitFrameResult.
+  Blit,         // Microseconds spent drawing the content frame.
+  PoseLatency   // Microseconds between publishing a pose and the frame rendered with it.
+};
+const int32_t TelemetryMetricCount = 4;
+inline int32_t TelemetryMetricIndex(const TelemetryMetric aMetric) { return static_cast<int32_t>(aMetric); }
+const char* TelemetryMetricName(const TelemetryMetric aMetric);
+
+class ImmersiveTelemetry;
+typedef std::shared_ptr<ImmersiveTelemetry> ImmersiveTelemetryPtr;
+
+// Log linear histograms of immersive session performance. Each power of two range
+// is split into eight buckets, so recorded values keep about 12% precision from
+// single units up to minutes. Samples are recorded by the render thread without
+// locking or allocating and may be read from any thread.
+class ImmersiveTelemetry {
+public:
+  struct Summary {
+    uint64_t count;
+    int64_t max;
+    int64_t p50;
+    int64_t p90;
+    int64_t p99;
+    Summary() : count(0), max(0), p50(0), p90(0), p99(0) {}
+  };
+  static const int32_t kBucketCount = 256;
+  // Smallest value that falls into aBucket.
+  static int64_t BucketLowerBound(const int32_t aBucket);
+
+  static ImmersiveTelemetryPtr Create();
+  void Reset();
+  void AddSample(const TelemetryMetric aMetric, const int64_t aValue);
+  // Records the content frame id shown this frame and counts skipped and repeated frames.
+  void RecordFrameId(const uint64_t aFrameId);
+  uint64_t GetSkippedFrames() const;
+  uint64_t GetRepeatedFrames() const;
+  void GetHistogram(const TelemetryMetric aMetric, uint64_t aCounts[kBucketCount]) const;
+  Summary GetSummary(const TelemetryMetric aMetric) const;
+  bool DumpToFile(const std::string& aPath) const;
+protected:
+  struct State;
+  ImmersiveTelemetry(State& aState);
+  ~ImmersiveTelemetry();
+private:
+  State& m;
+  ImmersiveTelemetry() = delete;
+  VRB_NO_DEFAULTS(ImmersiveTelemetry)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_IMMERSIVETELEMETRY_H
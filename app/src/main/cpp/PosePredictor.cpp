@@ -0,0 +1,194 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "PosePredictor.h"
+#include "vrb/ConcreteClass.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const uint32_t kHistorySize = 64;
+// Marks history entries that have not been written yet.
+const uint64_t kNoFrame = ~(uint64_t)0;
+// Weight of the newest velocity measurement, smooths out tracking noise.
+const float kVelocitySmoothing = 0.5f;
+// Samples closer than this are treated as duplicates for velocity purposes.
+const double kMinSampleInterval = 0.0005;
+// Never extrapolate further than this.
+const double kMaxPrediction = 0.1;
+
+void
+QuaternionMultiply(const float* aLeft, const float* aRight, float* aResult) {
+  const float x = aLeft[3] * aRight[0] + aLeft[0] * aRight[3] + aLeft[1] * aRight[2] - aLeft[2] * aRight[1];
+  const float y = aLeft[3] * aRight[1] - aLeft[0] * aRight[2] + aLeft[1] * aRight[3] + aLeft[2] * aRight[0];
+  const float z = aLeft[3] * aRight[2] + aLeft[0] * aRight[1] - aLeft[1] * aRight[0] + aLeft[2] * aRight[3];
+  const float w = aLeft[3] * aRight[3] - aLeft[0] * aRight[0] - aLeft[1] * aRight[1] - aLeft[2] * aRight[2];
+  aResult[0] = x;
+  aResult[1] = y;
+  aResult[2] = z;
+  aResult[3] = w;
+}
+
+void
+QuaternionNormalize(float* aQuaternion) {
+  const float length = sqrtf(aQuaternion[0] * aQuaternion[0] + aQuaternion[1] * aQuaternion[1] +
+                             aQuaternion[2] * aQuaternion[2] + aQuaternion[3] * aQuaternion[3]);
+  if (length > 0.0f) {
+    for (int index = 0; index < 4; index++) {
+      aQuaternion[index] /= length;
+    }
+  }
+}
+
+// Angular velocity, in world space radians per second, that rotates aFrom into aTo in aSeconds.
+void
+AngularVelocity(const float* aFrom, const float* aTo, const float aSeconds, float* aResult) {
+  const float inverseFrom[4] = {-aFrom[0], -aFrom[1], -aFrom[2], aFrom[3]};
+  float delta[4];
+  QuaternionMultiply(aTo, inverseFrom, delta);
+  if (delta[3] < 0.0f) {
+    // Take the shortest arc.
+    for (float& value: delta) {
+      value = -value;
+    }
+  }
+  const float sinHalfAngle = sqrtf(delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2]);
+  const float angle = 2.0f * atan2f(sinHalfAngle, delta[3]);
+  for (int index = 0; index < 3; index++) {
+    aResult[index] = sinHalfAngle > 0.0f ? (delta[index] / sinHalfAngle) * angle / aSeconds : 0.0f;
+  }
+}
+
+// Rotates aOrientation by aAngularVelocity applied for aSeconds.
+void
+Integrate(const float* aOrientation, const float* aAngularVelocity, const float aSeconds, float* aResult) {
+  const float speed = sqrtf(aAngularVelocity[0] * aAngularVelocity[0] +
+                            aAngularVelocity[1] * aAngularVelocity[1] +
+                            aAngularVelocity[2] * aAngularVelocity[2]);
+  const float halfAngle = 0.5f * speed * aSeconds;
+  if (speed <= 0.0f || halfAngle == 0.0f) {
+    memcpy(aResult, aOrientation, sizeof(float) * 4);
+    return;
+  }
+  const float scale = sinf(halfAngle) / speed;
+  const float delta[4] = {
+      aAngularVelocity[0] * scale,
+      aAngularVelocity[1] * scale,
+      aAngularVelocity[2] * scale,
+      cosf(halfAngle)
+  };
+  QuaternionMultiply(delta, aOrientation, aResult);
+  QuaternionNormalize(aResult);
+}
+
+} // namespace
+
+namespace crow {
+
+struct PosePredictor::State {
+  PoseSample history[kHistorySize];
+  uint32_t count;
+  uint32_t newest;
+
+  State() {
+    Reset();
+  }
+
+  void Reset() {
+    memset(history, 0, sizeof(history));
+    for (PoseSample& sample: history) {
+      sample.inputFrameID = kNoFrame;
+    }
+    count = 0;
+    newest = 0;
+  }
+};
+
+PosePredictorPtr
+PosePredictor::Create() {
+  return std::make_shared<vrb::ConcreteClass<PosePredictor, PosePredictor::State> >();
+}
+
+void
+PosePredictor::Reset() {
+  m.Reset();
+}
+
+const PoseSample&
+PosePredictor::AddSample(const uint64_t aInputFrameID, const double aTime,
+                         const float aOrientation[4], const float aPosition[3]) {
+  const PoseSample previous = m.history[m.newest];
+  const bool hasPrevious = m.count > 0;
+  m.newest = (uint32_t)(aInputFrameID % kHistorySize);
+  PoseSample& sample = m.history[m.newest];
+  memset(&sample, 0, sizeof(sample));
+  sample.inputFrameID = aInputFrameID;
+  sample.time = aTime;
+  memcpy(sample.orientation, aOrientation, sizeof(sample.orientation));
+  QuaternionNormalize(sample.orientation);
+  memcpy(sample.position, aPosition, sizeof(sample.position));
+  if (m.count < kHistorySize) {
+    m.count++;
+  }
+
+  if (!hasPrevious) {
+    return sample;
+  }
+  const double interval = aTime - previous.time;
+  if (interval < kMinSampleInterval) {
+    memcpy(sample.angularVelocity, previous.angularVelocity, sizeof(sample.angularVelocity));
+    memcpy(sample.linearVelocity, previous.linearVelocity, sizeof(sample.linearVelocity));
+    return sample;
+  }
+  float angular[3];
+  AngularVelocity(previous.orientation, sample.orientation, (float)interval, angular);
+  for (int index = 0; index < 3; index++) {
+    const float linear = (sample.position[index] - previous.position[index]) / (float)interval;
+    sample.angularVelocity[index] = kVelocitySmoothing * angular[index] +
+                                    (1.0f - kVelocitySmoothing) * previous.angularVelocity[index];
+    sample.linearVelocity[index] = kVelocitySmoothing * linear +
+                                   (1.0f - kVelocitySmoothing) * previous.linearVelocity[index];
+  }
+  return sample;
+}
+
+bool
+PosePredictor::Predict(const double aTime, PoseSample& aResult) const {
+  if (m.count == 0) {
+    return false;
+  }
+  const PoseSample& newest = m.history[m.newest];
+  aResult = newest;
+  double ahead = aTime - newest.time;
+  if (ahead <= 0.0) {
+    return true;
+  }
+  if (ahead > kMaxPrediction) {
+    ahead = kMaxPrediction;
+  }
+  aResult.time = newest.time + ahead;
+  Integrate(newest.orientation, newest.angularVelocity, (float)ahead, aResult.orientation);
+  for (int index = 0; index < 3; index++) {
+    aResult.position[index] = newest.position[index] + newest.linearVelocity[index] * (float)ahead;
+  }
+  return true;
+}
+
+bool
+PosePredictor::FindSample(const uint64_t aInputFrameID, PoseSample& aResult) const {
+  const PoseSample& sample = m.history[aInputFrameID % kHistorySize];
+  if (aInputFrameID == kNoFrame || sample.inputFrameID != aInputFrameID) {
+    return false;
+  }
+  aResult = sample;
+  return true;
+}
+
+PosePredictor::PosePredictor(State& aState) : m(aState) {}
+PosePredictor::~PosePredictor() {}
+
+} // namespace crow
@@ -0,0 +1,55 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_POSEPREDICTOR_H
+#define VRBROWSER_POSEPREDICTOR_H
+
+#include "vrb/MacroUtils.h"
+#include <memory>
+#include <stdint.h>
+
+namespace crow {
+
+// One timestamped pose. Quaternions are stored x, y, z, w. Copy the fields into
+// mozilla::gfx::VRPose one by one, the layouts differ.
+struct PoseSample {
+  uint64_t inputFrameID;
+  double time;
+  float orientation[4];
+  float position[3];
+  float angularVelocity[3];
+  float linearVelocity[3];
+};
+
+class PosePredictor;
+typedef std::shared_ptr<PosePredictor> PosePredictorPtr;
+
+// Keeps a short history of timestamped poses for one tracked object, keyed by the
+// inputFrameID they were published with, and extrapolates them with the measured
+// angular and linear velocity.
+class PosePredictor {
+public:
+  static PosePredictorPtr Create();
+  void Reset();
+  // aTime is in seconds. Velocities are derived from the previous sample.
+  const PoseSample& AddSample(const uint64_t aInputFrameID, const double aTime,
+                              const float aOrientation[4], const float aPosition[3]);
+  // Extrapolates the most recent sample to aTime. Returns false if there are no samples.
+  bool Predict(const double aTime, PoseSample& aResult) const;
+  // Returns false if the sample has already been overwritten or was never added.
+  bool FindSample(const uint64_t aInputFrameID, PoseSample& aResult) const;
+protected:
+  struct State;
+  PosePredictor(State& aState);
+  ~PosePredictor();
+private:
+  State& m;
+  PosePredictor() = delete;
+  VRB_NO_DEFAULTS(PosePredictor)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_POSEPREDICTOR_H
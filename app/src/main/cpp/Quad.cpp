@@ -37,6 +37,8 @@ struct Quad::State {
   vrb::TransformPtr backgroundTransform;
   vrb::GeometryPtr backgroundGeometry;
   vrb::Color backgroundColor;
+  // Part of the texture the quad shows, in texture coordinates with the origin at the top left.
+  device::EyeRect textureRect;
 
   State()
       : textureWidth(0)
@@ -44,6 +46,7 @@ struct Quad::State {
       , scaleMode(ScaleMode::Fill)
       , worldMin(0.0f, 0.0f, 0.0f)
       , worldMax(0.0f, 0.0f, 0.0f)
+      , textureRect(0.0f, 0.0f, 1.0f, 1.0f)
   {}
 
   void Initialize() {
@@ -112,11 +115,7 @@ struct Quad::State {
         layer->SetTextureRect(device::Eye::Left, textureRect);
         layer->SetTextureRect(device::Eye::Right, textureRect);
       } else {
-        vrb::VertexArrayPtr array = geometry->GetVertexArray();
-        array->SetUV(0, vrb::Vector(u0, v0 + vl, 0.0f));
-        array->SetUV(1, vrb::Vector(u0 + ul, v0 + vl, 0.0f));
-        array->SetUV(2, vrb::Vector(u0 + ul, v0, 0.0f));
-        array->SetUV(3, vrb::Vector(u0, v0, 0.0f));
+        SetUVs(u0, v0, ul, vl);
       }
     }
 
@@ -133,6 +132,19 @@ struct Quad::State {
     }
   }
 
+  // Maps the given part of textureRect onto the quad.
+  void SetUVs(const float aU, const float aV, const float aWidth, const float aHeight) {
+    const float u0 = textureRect.mX + aU * textureRect.mWidth;
+    const float v0 = textureRect.mY + aV * textureRect.mHeight;
+    const float ul = aWidth * textureRect.mWidth;
+    const float vl = aHeight * textureRect.mHeight;
+    vrb::VertexArrayPtr array = geometry->GetVertexArray();
+    array->SetUV(0, vrb::Vector(u0, v0 + vl, 0.0f));
+    array->SetUV(1, vrb::Vector(u0 + ul, v0 + vl, 0.0f));
+    array->SetUV(2, vrb::Vector(u0 + ul, v0, 0.0f));
+    array->SetUV(3, vrb::Vector(u0, v0, 0.0f));
+  }
+
   void LayoutBackground() {
     if (!backgroundTransform) {
       return;
@@ -240,6 +252,22 @@ Quad::SetTexture(const vrb::TexturePtr& aTexture, int32_t aWidth, int32_t aHeigh
   }
 }
 
+void
+Quad::SetTextureRect(const device::EyeRect& aRect) {
+  m.textureRect = aRect;
+  if (m.layer) {
+    m.layer->SetTextureRect(device::Eye::Left, aRect);
+    m.layer->SetTextureRect(device::Eye::Right, aRect);
+    return;
+  }
+  if (m.scaleMode == ScaleMode::AspectFill) {
+    m.UpdateVertexArray();
+  } else {
+    m.SetUVs(0.0f, 0.0f, 1.0f, 1.0f);
+    m.geometry->UpdateBuffers();
+  }
+}
+
 void
 Quad::SetMaterial(const vrb::Color& aAmbient, const vrb::Color& aDiffuse, const vrb::Color& aSpecular, const float aSpecularExponent) {
   m.geometry->GetRenderState()->SetMaterial(aAmbient, aDiffuse, aSpecular, aSpecularExponent);
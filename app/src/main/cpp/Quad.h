@@ -37,6 +37,8 @@ public:
   static vrb::GeometryPtr CreateGeometry(vrb::CreationContextPtr aContext, const float aWorldWidth, const float aWorldHeight);
   static vrb::GeometryPtr CreateGeometry(vrb::CreationContextPtr aContext, const vrb::Vector& aMin, const vrb::Vector& aMax, const device::EyeRect& aRect);
   void SetTexture(const vrb::TexturePtr& aTexture, int32_t aWidth, int32_t aHeight);
+  // Shows only aRect of the texture, e.g. a widget's slot in a WidgetAtlas.
+  void SetTextureRect(const device::EyeRect& aRect);
   void SetMaterial(const vrb::Color& aAmbient, const vrb::Color& aDiffuse, const vrb::Color& aSpecular, const float aSpecularExponent);
   void SetScaleMode(ScaleMode aScaleMode);
   void SetBackgroundColor(const vrb::Color& aColor);
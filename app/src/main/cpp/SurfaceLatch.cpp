@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "SurfaceLatch.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+
+namespace crow {
+
+struct SurfaceLatch::State {
+  SurfaceSourcePtr source;
+  void* attachedContext;
+  bool latched;
+  Stats stats;
+  State() : attachedContext(nullptr), latched(false) {}
+
+  bool EnsureAttached(void* aContext, const uint32_t aTexture) {
+    if (attachedContext == aContext && source->DetectsDetach()) {
+      return true;
+    }
+    stats.attachQueries++;
+    if (!source->IsAttached(aContext)) {
+      if (!source->Attach(aContext, aTexture)) {
+        attachedContext = nullptr;
+        return false;
+      }
+      stats.attached++;
+    }
+    attachedContext = aContext;
+    return true;
+  }
+};
+
+SurfaceLatchPtr
+SurfaceLatch::Create(const SurfaceSourcePtr& aSource) {
+  SurfaceLatchPtr result = std::make_shared<vrb::ConcreteClass<SurfaceLatch, SurfaceLatch::State> >();
+  result->m.source = aSource;
+  return result;
+}
+
+bool
+SurfaceLatch::Latch(void* aContext, const uint32_t aTexture) {
+  if (!m.EnsureAttached(aContext, aTexture)) {
+    m.stats.failed++;
+    return false;
+  }
+  SurfaceSource::UpdateResult result = m.source->Update();
+  if (result == SurfaceSource::UpdateResult::NotAttached) {
+    // Another consumer took the surface since the last frame.
+    m.attachedContext = nullptr;
+    if (m.EnsureAttached(aContext, aTexture)) {
+      result = m.source->Update();
+    }
+  }
+  if (result != SurfaceSource::UpdateResult::Latched) {
+    VRB_ERROR("Failed to latch surface frame");
+    m.stats.failed++;
+    return false;
+  }
+  m.latched = true;
+  m.stats.latched++;
+  return true;
+}
+
+void
+SurfaceLatch::Release() {
+  if (!m.latched) {
+    m.stats.skippedReleases++;
+    return;
+  }
+  m.source->Release();
+  m.latched = false;
+  m.stats.released++;
+}
+
+void
+SurfaceLatch::Detach(void* aContext) {
+  if (m.source->IsAttached(aContext)) {
+    m.source->Detach();
+  }
+  m.attachedContext = nullptr;
+}
+
+bool
+SurfaceLatch::IsLatched() const {
+  return m.latched;
+}
+
+const SurfaceLatch::Stats&
+SurfaceLatch::GetStats() const {
+  return m.stats;
+}
+
+SurfaceLatch::SurfaceLatch(State& aState) : m(aState) {}
+SurfaceLatch::~SurfaceLatch() {}
+
+} // namespace crow
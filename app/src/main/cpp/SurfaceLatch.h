@@ -0,0 +1,77 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_SURFACELATCH_H
+#define VRBROWSER_SURFACELATCH_H
+
+#include "vrb/MacroUtils.h"
+#include <memory>
+#include <stdint.h>
+
+namespace crow {
+
+class SurfaceSource;
+typedef std::shared_ptr<SurfaceSource> SurfaceSourcePtr;
+
+// The consumer side of a producer/consumer surface queue. GeckoSurfaceTexture
+// implements it over ASurfaceTexture or JNI; a fake producer implements it on a host.
+// Contexts are opaque EGLContext values.
+class SurfaceSource {
+public:
+  enum class UpdateResult {
+    Latched,
+    NotAttached,
+    Failed
+  };
+  virtual bool IsAttached(void* aContext) = 0;
+  virtual bool Attach(void* aContext, const uint32_t aTexture) = 0;
+  virtual void Detach() = 0;
+  virtual UpdateResult Update() = 0;
+  virtual void Release() = 0;
+  // True if Update reports NotAttached once another consumer has taken the surface.
+  // Sources that can not tell are queried with IsAttached before every update.
+  virtual bool DetectsDetach() const = 0;
+  virtual ~SurfaceSource() {}
+};
+
+class SurfaceLatch;
+typedef std::shared_ptr<SurfaceLatch> SurfaceLatchPtr;
+
+// Latches frames from a SurfaceSource into a texture. Remembers which context the
+// source is attached to and whether a frame is held, so that a steady stream of
+// frames costs one Update per frame plus one Release when the source needs it.
+class SurfaceLatch {
+public:
+  struct Stats {
+    uint64_t latched;
+    uint64_t failed;
+    uint64_t attached;
+    uint64_t attachQueries;
+    uint64_t released;
+    uint64_t skippedReleases;
+    Stats() : latched(0), failed(0), attached(0), attachQueries(0), released(0), skippedReleases(0) {}
+  };
+
+  static SurfaceLatchPtr Create(const SurfaceSourcePtr& aSource);
+  // Attaches to aContext if needed and latches the newest frame into aTexture.
+  bool Latch(void* aContext, const uint32_t aTexture);
+  // Returns the held frame to the producer. Does nothing if no frame is held.
+  void Release();
+  void Detach(void* aContext);
+  bool IsLatched() const;
+  const Stats& GetStats() const;
+protected:
+  struct State;
+  SurfaceLatch(State& aState);
+  ~SurfaceLatch();
+private:
+  State& m;
+  SurfaceLatch() = delete;
+  VRB_NO_DEFAULTS(SurfaceLatch)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_SURFACELATCH_H
@@ -7,6 +7,7 @@
 #include "vrb/ConcreteClass.h"
 #include "vrb/Logger.h"
 #include "JNIUtil.h"
+#include "BrowserEventQueue.h"
 
 namespace {
 
@@ -14,18 +15,8 @@ static const char* kDispatchCreateWidgetName = "dispatchCreateWidget";
 static const char* kDispatchCreateWidgetSignature = "(ILandroid/graphics/SurfaceTexture;II)V";
 static const char* kDispatchCreateWidgetLayerName = "dispatchCreateWidgetLayer";
 static const char* kDispatchCreateWidgetLayerSignature = "(ILandroid/view/Surface;IIJ)V";
-static const char* kHandleMotionEventName = "handleMotionEvent";
-static const char* kHandleMotionEventSignature = "(IIZFF)V";
-static const char* kHandleScrollEventName = "handleScrollEvent";
-static const char* kHandleScrollEventSignature = "(IIFF)V";
-static const char* kHandleAudioPoseName = "handleAudioPose";
-static const char* kHandleAudioPoseSignature = "(FFFFFFF)V";
-static const char* kHandleGestureName = "handleGesture";
-static const char* kHandleGestureSignature = "(I)V";
-static const char* kHandleResizeName = "handleResize";
-static const char* kHandleResizeSignature = "(IFF)V";
-static const char* kHandleBackEventName = "handleBack";
-static const char* kHandleBackEventSignature = "()V";
+static const char* kDispatchCreateAtlasWidgetName = "dispatchCreateAtlasWidget";
+static const char* kDispatchCreateAtlasWidgetSignature = "(ILandroid/graphics/SurfaceTexture;IIIIII)V";
 static const char* kRegisterExternalContextName = "registerExternalContext";
 static const char* kRegisterExternalContextSignature = "(J)V";
 static const char* kPauseCompositorName = "pauseGeckoViewCompositor";
@@ -49,12 +40,7 @@ static JNIEnv* sEnv;
 static jobject sActivity;
 static jmethodID sDispatchCreateWidget;
 static jmethodID sDispatchCreateWidgetLayer;
-static jmethodID sHandleMotionEvent;
-static jmethodID sHandleScrollEvent;
-static jmethodID sHandleAudioPose;
-static jmethodID sHandleGesture;
-static jmethodID sHandleResize;
-static jmethodID sHandleBack;
+static jmethodID sDispatchCreateAtlasWidget;
 static jmethodID sRegisterExternalContext;
 static jmethodID sPauseCompositor;
 static jmethodID sResumeCompositor;
@@ -64,6 +50,26 @@ static jmethodID sIsOverrideEnvPathEnabled;
 static jmethodID sGetActiveEnvironment;
 static jmethodID sGetPointerColor;
 static jmethodID sAreLayersEnabled;
+
+// Outlives InitializeJava/ShutdownJava so the Java event thread never sees it change.
+static crow::BrowserEventQueuePtr sEventQueue = crow::BrowserEventQueue::Create();
+
+void
+PushEvent(const crow::BrowserEventType aType, const int32_t aHandle, const int32_t aController,
+          const bool aPressed, const float* aValues, const int32_t aValueCount) {
+  if (!sActivity) {
+    return;
+  }
+  crow::BrowserEvent event = {};
+  event.type = static_cast<int32_t>(aType);
+  event.handle = aHandle;
+  event.controller = aController;
+  event.pressed = aPressed ? 1 : 0;
+  for (int32_t index = 0; index < aValueCount; index++) {
+    event.values[index] = aValues[index];
+  }
+  sEventQueue->Push(event);
+}
 }
 
 namespace crow {
@@ -85,12 +91,7 @@ VRBrowser::InitializeJava(JNIEnv* aEnv, jobject aActivity) {
 
   sDispatchCreateWidget = FindJNIMethodID(sEnv, browserClass, kDispatchCreateWidgetName, kDispatchCreateWidgetSignature);
   sDispatchCreateWidgetLayer = FindJNIMethodID(sEnv, browserClass, kDispatchCreateWidgetLayerName, kDispatchCreateWidgetLayerSignature);
-  sHandleMotionEvent = FindJNIMethodID(sEnv, browserClass, kHandleMotionEventName, kHandleMotionEventSignature);
-  sHandleScrollEvent = FindJNIMethodID(sEnv, browserClass, kHandleScrollEventName, kHandleScrollEventSignature);
-  sHandleAudioPose = FindJNIMethodID(sEnv, browserClass, kHandleAudioPoseName, kHandleAudioPoseSignature);
-  sHandleGesture = FindJNIMethodID(sEnv, browserClass, kHandleGestureName, kHandleGestureSignature);
-  sHandleResize = FindJNIMethodID(sEnv, browserClass, kHandleResizeName, kHandleResizeSignature);
-  sHandleBack = FindJNIMethodID(sEnv, browserClass, kHandleBackEventName, kHandleBackEventSignature);
+  sDispatchCreateAtlasWidget = FindJNIMethodID(sEnv, browserClass, kDispatchCreateAtlasWidgetName, kDispatchCreateAtlasWidgetSignature);
   sRegisterExternalContext = FindJNIMethodID(sEnv, browserClass, kRegisterExternalContextName, kRegisterExternalContextSignature);
   sPauseCompositor = FindJNIMethodID(sEnv, browserClass, kPauseCompositorName, kPauseCompositorSignature);
   sResumeCompositor = FindJNIMethodID(sEnv, browserClass, kResumeCompositorName, kResumeCompositorSignature);
@@ -111,15 +112,11 @@ VRBrowser::ShutdownJava() {
     sEnv->DeleteGlobalRef(sActivity);
     sActivity = nullptr;
   }
+  sEventQueue->Wake();
 
   sDispatchCreateWidget = nullptr;
   sDispatchCreateWidgetLayer = nullptr;
-  sHandleMotionEvent = nullptr;
-  sHandleScrollEvent = nullptr;
-  sHandleAudioPose = nullptr;
-  sHandleGesture = nullptr;
-  sHandleResize = nullptr;
-  sHandleBack = nullptr;
+  sDispatchCreateAtlasWidget = nullptr;
   sRegisterExternalContext = nullptr;
   sPauseCompositor = nullptr;
   sResumeCompositor = nullptr;
@@ -146,47 +143,53 @@ VRBrowser::DispatchCreateWidgetLayer(jint aWidgetHandle, jobject aSurface, jint
   CheckJNIException(sEnv, __FUNCTION__);
 }
 
-
 void
-VRBrowser::HandleMotionEvent(jint aWidgetHandle, jint aController, jboolean aPressed, jfloat aX, jfloat aY) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleMotionEvent, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleMotionEvent, aWidgetHandle, aController, aPressed, aX, aY);
+VRBrowser::DispatchCreateAtlasWidget(jint aWidgetHandle, jobject aSurface, jint aAtlasWidth, jint aAtlasHeight,
+                                     jint aX, jint aY, jint aWidth, jint aHeight) {
+  if (!ValidateMethodID(sEnv, sActivity, sDispatchCreateAtlasWidget, __FUNCTION__)) { return; }
+  sEnv->CallVoidMethod(sActivity, sDispatchCreateAtlasWidget, aWidgetHandle, aSurface, aAtlasWidth, aAtlasHeight,
+                       aX, aY, aWidth, aHeight);
   CheckJNIException(sEnv, __FUNCTION__);
 }
 
+
 void
-VRBrowser::HandleScrollEvent(jint aWidgetHandle, jint aController, jfloat aX, jfloat aY) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleScrollEvent, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleScrollEvent, aWidgetHandle, aController, aX, aY);
-  CheckJNIException(sEnv, __FUNCTION__);
+VRBrowser::HandleMotionEvent(jint aWidgetHandle, jint aController, jboolean aPressed, jfloat aX, jfloat aY) {
+  const float values[] = {aX, aY};
+  PushEvent(BrowserEventType::Motion, aWidgetHandle, aController, aPressed, values, 2);
 }
 
 void
-VRBrowser::HandleAudioPose(jfloat qx, jfloat qy, jfloat qz, jfloat qw, jfloat px, jfloat py, jfloat pz) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleAudioPose, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleAudioPose, qx, qy, qz, qw, px, py, pz);
-  CheckJNIException(sEnv, __FUNCTION__);
+VRBrowser::HandleScrollEvent(jint aWidgetHandle, jint aController, jfloat aX, jfloat aY) {
+  const float values[] = {aX, aY};
+  PushEvent(BrowserEventType::Scroll, aWidgetHandle, aController, false, values, 2);
 }
 
 void
 VRBrowser::HandleGesture(jint aType) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleGesture, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleGesture, aType);
-  CheckJNIException(sEnv, __FUNCTION__);
+  PushEvent(BrowserEventType::Gesture, aType, 0, false, nullptr, 0);
 }
 
 void
 VRBrowser::HandleResize(jint aWidgetHandle, jfloat aWorldWidth, jfloat aWorldHeight) {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleResize, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleResize, aWidgetHandle, aWorldWidth, aWorldHeight);
-  CheckJNIException(sEnv, __FUNCTION__);
+  const float values[] = {aWorldWidth, aWorldHeight};
+  PushEvent(BrowserEventType::Resize, aWidgetHandle, 0, false, values, 2);
 }
 
 void
 VRBrowser::HandleBack() {
-  if (!ValidateMethodID(sEnv, sActivity, sHandleBack, __FUNCTION__)) { return; }
-  sEnv->CallVoidMethod(sActivity, sHandleBack);
-  CheckJNIException(sEnv, __FUNCTION__);
+  PushEvent(BrowserEventType::Back, 0, 0, false, nullptr, 0);
+}
+
+int32_t
+VRBrowser::DrainEvents(void* aBuffer, jlong aCapacity, jint aTimeoutMs) {
+  const int32_t maxEvents = (int32_t)(aCapacity / kBrowserEventSize);
+  return sEventQueue->Drain(static_cast<BrowserEvent*>(aBuffer), maxEvents, aTimeoutMs);
+}
+
+void
+VRBrowser::WakeEventConsumer() {
+  sEventQueue->Wake();
 }
 
 void
@@ -20,12 +20,17 @@ void InitializeJava(JNIEnv* aEnv, jobject aActivity);
 void ShutdownJava();
 void DispatchCreateWidget(jint aWidgetHandle, jobject aSurfaceTexture, jint aWidth, jint aHeight);
 void DispatchCreateWidgetLayer(jint aWidgetHandle, jobject aSurface, jint aWidth, jint aHeight, const std::function<void()>& aFirstCompositeCallback);
+void DispatchCreateAtlasWidget(jint aWidgetHandle, jobject aSurfaceTexture, jint aAtlasWidth, jint aAtlasHeight,
+                               jint aX, jint aY, jint aWidth, jint aHeight);
 void HandleMotionEvent(jint aWidgetHandle, jint aController, jboolean aPressed, jfloat aX, jfloat aY);
 void HandleScrollEvent(jint aWidgetHandle, jint aController, jfloat aX, jfloat aY);
-void HandleAudioPose(jfloat qx, jfloat qy, jfloat qz, jfloat qw, jfloat px, jfloat py, jfloat pz);
 void HandleGesture(jint aType);
 void HandleResize(jint aWidgetHandle, jfloat aWorldWidth, jfloat aWorldHeight);
 void HandleBack();
+// The Handle* calls above only queue the event; the Java event thread collects
+// them in batches through DrainEvents, which blocks for at most aTimeoutMs.
+int32_t DrainEvents(void* aBuffer, jlong aCapacity, jint aTimeoutMs);
+void WakeEventConsumer();
 void RegisterExternalContext(jlong aContext);
 void PauseCompositor();
 void ResumeCompositor();
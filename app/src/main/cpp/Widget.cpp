@@ -7,6 +7,7 @@
 #include "Quad.h"
 #include "VRLayer.h"
 #include "VRBrowser.h"
+#include "WidgetAtlas.h"
 #include "WidgetPlacement.h"
 #include "WidgetResizer.h"
 #include "vrb/ConcreteClass.h"
@@ -31,6 +32,7 @@ struct Widget::State {
   uint32_t handle;
   QuadPtr quad;
   VRLayerQuadPtr layer;
+  WidgetAtlasPtr atlas;
   vrb::TogglePtr root;
   vrb::TransformPtr transform;
   vrb::TextureSurfacePtr surface;
@@ -59,6 +61,8 @@ struct Widget::State {
         const VRLayerQuad& layerQuad = static_cast<const VRLayerQuad&>(aLayer);
         VRBrowser::DispatchCreateWidgetLayer((jint)aHandle, layerQuad.GetSurface(), layerQuad.GetWidth(), layerQuad.GetHeight(), aCallback);
       });
+    } else if (atlas) {
+      surface = atlas->GetSurfaceTexture();
     } else {
       surface = vrb::TextureSurface::Create(render, name);
     }
@@ -68,6 +72,9 @@ struct Widget::State {
       quad->SetTexture(surface, aTextureWidth, aTextureHeight);
       quad->SetMaterial(vrb::Color(0.4f, 0.4f, 0.4f), vrb::Color(1.0f, 1.0f, 1.0f), vrb::Color(0.0f, 0.0f, 0.0f), 0.0f);
     }
+    if (atlas) {
+      quad->SetTextureRect(atlas->GetTextureRect(handle));
+    }
 
     transform = vrb::Transform::Create(create);
     transform->AddNode(quad->GetRoot());
@@ -119,6 +126,18 @@ Widget::Create(vrb::RenderContextPtr& aContext, const int aHandle, const int32_t
   return result;
 }
 
+WidgetPtr
+Widget::Create(vrb::RenderContextPtr& aContext, const int aHandle, const WidgetAtlasPtr& aAtlas, const int32_t aWidth, const int32_t aHeight, float aWorldWidth) {
+  WidgetPtr result = std::make_shared<vrb::ConcreteClass<Widget, Widget::State> >(aContext);
+  const float aspect = (float)aWidth / (float)aHeight;
+  const float worldHeight = aWorldWidth / aspect;
+  vrb::Vector windowMin(-aWorldWidth * 0.5f, -worldHeight * 0.5f, 0.0f);
+  vrb::Vector windowMax(aWorldWidth *0.5f, worldHeight * 0.5f, 0.0f);
+  result->m.atlas = aAtlas;
+  result->m.Initialize(aHandle, windowMin, windowMax, aWidth, aHeight, nullptr);
+  return result;
+}
+
 uint32_t
 Widget::GetHandle() const {
   return m.handle;
@@ -243,6 +262,18 @@ Widget::GetLayer() const {
   return m.layer;
 }
 
+const WidgetAtlasPtr&
+Widget::GetAtlas() const {
+  return m.atlas;
+}
+
+void
+Widget::UpdateAtlasSlot() {
+  if (m.atlas) {
+    m.quad->SetTextureRect(m.atlas->GetTextureRect(m.handle));
+  }
+}
+
 vrb::TransformPtr
 Widget::GetTransformNode() const {
   return m.transform;
@@ -29,11 +29,16 @@ typedef std::shared_ptr<Widget> WidgetPtr;
 class WidgetPlacement;
 typedef std::shared_ptr<WidgetPlacement> WidgetPlacementPtr;
 
+class WidgetAtlas;
+typedef std::shared_ptr<WidgetAtlas> WidgetAtlasPtr;
+
 class Widget {
 public:
   static WidgetPtr Create(vrb::RenderContextPtr& aContext, const int aHandle, const int32_t aWidth, const int32_t aHeight, float aWorldWidth);
   static WidgetPtr Create(vrb::RenderContextPtr& aContext, const int aHandle, const VRLayerQuadPtr& aLayer, float aWorldWidth);
   static WidgetPtr Create(vrb::RenderContextPtr& aContext, const int aHandle, const int32_t aWidth, const int32_t aHeight, const vrb::Vector& aMin, const vrb::Vector& aMax);
+  // The widget draws into its slot of aAtlas, which must already have been allocated.
+  static WidgetPtr Create(vrb::RenderContextPtr& aContext, const int aHandle, const WidgetAtlasPtr& aAtlas, const int32_t aWidth, const int32_t aHeight, float aWorldWidth);
   uint32_t GetHandle() const;
   void ResetFirstDraw();
   const std::string& GetSurfaceTextureName() const;
@@ -53,6 +58,9 @@ public:
   vrb::NodePtr GetRoot() const;
   QuadPtr GetQuad() const;
   const VRLayerQuadPtr& GetLayer() const;
+  const WidgetAtlasPtr& GetAtlas() const;
+  // Picks up a new slot after the atlas reallocated it.
+  void UpdateAtlasSlot();
   vrb::TransformPtr GetTransformNode() const;
   const WidgetPlacementPtr& GetPlacement() const;
   void SetPlacement(const WidgetPlacementPtr& aPlacement);
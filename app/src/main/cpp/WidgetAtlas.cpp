@@ -0,0 +1,212 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WidgetAtlas.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/Logger.h"
+#include "vrb/RenderContext.h"
+#include "vrb/TextureSurface.h"
+
+#include <unordered_map>
+
+namespace {
+// Keeps linear filtering from sampling a neighbouring slot.
+const int32_t kSlotPadding = 2;
+} // namespace
+
+namespace crow {
+
+struct WidgetAtlas::State {
+  struct Shelf {
+    int32_t y;
+    int32_t height;
+    int32_t nextX;
+    int32_t slots;
+  };
+  struct Slot {
+    size_t shelf;
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t capacityWidth;
+  };
+  std::string name;
+  vrb::TextureSurfacePtr surface;
+  int32_t width;
+  int32_t height;
+  std::vector<Shelf> shelves;
+  std::unordered_map<int32_t, Slot> slots;
+
+  State() : width(0), height(0) {}
+
+  int32_t NextShelfY() const {
+    return shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+  }
+
+  bool Reserve(const int32_t aWidth, const int32_t aHeight, Slot& aSlot) {
+    const int32_t paddedWidth = aWidth + kSlotPadding;
+    const int32_t paddedHeight = aHeight + kSlotPadding;
+    if (paddedWidth > width) {
+      return false;
+    }
+    // Best fit: the lowest shelf the slot fits in.
+    size_t best = shelves.size();
+    for (size_t index = 0; index < shelves.size(); index++) {
+      const Shelf& shelf = shelves[index];
+      if (shelf.height < paddedHeight || shelf.nextX + paddedWidth > width) {
+        continue;
+      }
+      if (best == shelves.size() || shelf.height < shelves[best].height) {
+        best = index;
+      }
+    }
+    if (best == shelves.size()) {
+      if (NextShelfY() + paddedHeight > height) {
+        return false;
+      }
+      Shelf shelf;
+      shelf.y = NextShelfY();
+      shelf.height = paddedHeight;
+      shelf.nextX = 0;
+      shelf.slots = 0;
+      shelves.push_back(shelf);
+    }
+    Shelf& shelf = shelves[best];
+    aSlot.shelf = best;
+    aSlot.x = shelf.nextX;
+    aSlot.y = shelf.y;
+    aSlot.width = aWidth;
+    aSlot.height = aHeight;
+    aSlot.capacityWidth = aWidth;
+    shelf.nextX += paddedWidth;
+    shelf.slots++;
+    return true;
+  }
+
+  void Release(const Slot& aSlot) {
+    Shelf& shelf = shelves[aSlot.shelf];
+    shelf.slots--;
+    if (shelf.slots > 0) {
+      return;
+    }
+    shelf.nextX = 0;
+    while (!shelves.empty() && shelves.back().slots == 0) {
+      shelves.pop_back();
+    }
+  }
+};
+
+WidgetAtlasPtr
+WidgetAtlas::Create(vrb::RenderContextPtr& aContext, const int32_t aWidth, const int32_t aHeight) {
+  WidgetAtlasPtr result = std::make_shared<vrb::ConcreteClass<WidgetAtlas, WidgetAtlas::State> >(aContext);
+  result->m.width = aWidth;
+  result->m.height = aHeight;
+  result->m.surface = vrb::TextureSurface::Create(aContext, result->m.name);
+  return result;
+}
+
+const std::string&
+WidgetAtlas::GetSurfaceTextureName() const {
+  return m.name;
+}
+
+const vrb::TextureSurfacePtr&
+WidgetAtlas::GetSurfaceTexture() const {
+  return m.surface;
+}
+
+int32_t
+WidgetAtlas::GetWidth() const {
+  return m.width;
+}
+
+int32_t
+WidgetAtlas::GetHeight() const {
+  return m.height;
+}
+
+bool
+WidgetAtlas::Allocate(const int32_t aHandle, const int32_t aWidth, const int32_t aHeight) {
+  if (aWidth <= 0 || aHeight <= 0) {
+    return false;
+  }
+  auto iter = m.slots.find(aHandle);
+  if (iter != m.slots.end()) {
+    State::Slot& slot = iter->second;
+    const State::Shelf& shelf = m.shelves[slot.shelf];
+    if (aWidth <= slot.capacityWidth && aHeight + kSlotPadding <= shelf.height) {
+      slot.width = aWidth;
+      slot.height = aHeight;
+      return true;
+    }
+  }
+  State::Slot slot;
+  if (!m.Reserve(aWidth, aHeight, slot)) {
+    VRB_LOG("No room in widget atlas for %d (%dx%d)", aHandle, aWidth, aHeight);
+    return false;
+  }
+  if (iter != m.slots.end()) {
+    m.Release(iter->second);
+  }
+  m.slots[aHandle] = slot;
+  return true;
+}
+
+void
+WidgetAtlas::Free(const int32_t aHandle) {
+  auto iter = m.slots.find(aHandle);
+  if (iter == m.slots.end()) {
+    return;
+  }
+  m.Release(iter->second);
+  m.slots.erase(iter);
+}
+
+bool
+WidgetAtlas::Contains(const int32_t aHandle) const {
+  return m.slots.find(aHandle) != m.slots.end();
+}
+
+bool
+WidgetAtlas::GetSlot(const int32_t aHandle, int32_t& aX, int32_t& aY, int32_t& aWidth, int32_t& aHeight) const {
+  auto iter = m.slots.find(aHandle);
+  if (iter == m.slots.end()) {
+    return false;
+  }
+  aX = iter->second.x;
+  aY = iter->second.y;
+  aWidth = iter->second.width;
+  aHeight = iter->second.height;
+  return true;
+}
+
+device::EyeRect
+WidgetAtlas::GetTextureRect(const int32_t aHandle) const {
+  int32_t x, y, width, height;
+  if (!GetSlot(aHandle, x, y, width, height)) {
+    return device::EyeRect(0.0f, 0.0f, 1.0f, 1.0f);
+  }
+  return device::EyeRect((float)x / (float)m.width, (float)y / (float)m.height,
+                         (float)width / (float)m.width, (float)height / (float)m.height);
+}
+
+std::vector<int32_t>
+WidgetAtlas::GetHandles() const {
+  std::vector<int32_t> result;
+  result.reserve(m.slots.size());
+  for (const auto& slot: m.slots) {
+    result.push_back(slot.first);
+  }
+  return result;
+}
+
+WidgetAtlas::WidgetAtlas(State& aState, vrb::RenderContextPtr& aContext) : m(aState) {
+  m.name = "crow::WidgetAtlas";
+}
+
+WidgetAtlas::~WidgetAtlas() {}
+
+} // namespace crow
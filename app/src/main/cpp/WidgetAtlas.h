@@ -0,0 +1,54 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_WIDGETATLAS_H
+#define VRBROWSER_WIDGETATLAS_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "Device.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace crow {
+
+class WidgetAtlas;
+typedef std::shared_ptr<WidgetAtlas> WidgetAtlasPtr;
+
+// One surface texture shared by small widgets. Each widget gets a slot, packed into
+// shelves, and draws only into its slot. Space in a shelf is reused once every slot
+// in it has been freed.
+class WidgetAtlas {
+public:
+  static WidgetAtlasPtr Create(vrb::RenderContextPtr& aContext, const int32_t aWidth, const int32_t aHeight);
+  const std::string& GetSurfaceTextureName() const;
+  const vrb::TextureSurfacePtr& GetSurfaceTexture() const;
+  int32_t GetWidth() const;
+  int32_t GetHeight() const;
+  // Reserves an aWidth x aHeight slot for aHandle, or resizes its current one. Returns
+  // false, keeping any current slot, if there is no room.
+  bool Allocate(const int32_t aHandle, const int32_t aWidth, const int32_t aHeight);
+  void Free(const int32_t aHandle);
+  bool Contains(const int32_t aHandle) const;
+  // Slot in pixels with the origin at the top left, as the widget draws into it.
+  bool GetSlot(const int32_t aHandle, int32_t& aX, int32_t& aY, int32_t& aWidth, int32_t& aHeight) const;
+  // Slot in texture coordinates.
+  device::EyeRect GetTextureRect(const int32_t aHandle) const;
+  std::vector<int32_t> GetHandles() const;
+protected:
+  struct State;
+  WidgetAtlas(State& aState, vrb::RenderContextPtr& aContext);
+  ~WidgetAtlas();
+private:
+  State& m;
+  WidgetAtlas() = delete;
+  VRB_NO_DEFAULTS(WidgetAtlas)
+};
+
+} // namespace crow
+
+#endif // VRBROWSER_WIDGETATLAS_H
@@ -21,9 +21,15 @@
 #include "mozilla/gfx/2D.h"
 #endif  // MOZILLA_INTERNAL_API
 
-#if defined(__ANDROID__)
+// Android shares pthread synchronization objects through the block. Host tools
+// that exchange the Android layout define GFX_VR_ANDROID_LAYOUT themselves.
+#if defined(__ANDROID__) && !defined(GFX_VR_ANDROID_LAYOUT)
+#define GFX_VR_ANDROID_LAYOUT
+#endif  // defined(__ANDROID__) && !defined(GFX_VR_ANDROID_LAYOUT)
+
+#if defined(GFX_VR_ANDROID_LAYOUT)
 #include <pthread.h>
-#endif  // defined(__ANDROID__)
+#endif  // defined(GFX_VR_ANDROID_LAYOUT)
 
 namespace mozilla {
 #ifdef MOZILLA_INTERNAL_API
@@ -36,6 +42,21 @@ namespace gfx {
 
 static const int32_t kVRExternalVersion = 5;
 
+#if defined(GFX_VR_ANDROID_LAYOUT) && defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+// Local Firefox Reality extension, not part of upstream Gecko. Only define
+// VRBROWSER_SHMEM_SEQLOCK_EXTENSION with a GeckoView build that carries the
+// matching patch, otherwise nothing writes browserSeqLockVersion.
+// The system and browser state mutexes may be replaced with generation counters
+// (a seqlock). The extension lives after the legacy layout and
+// VRExternalShmem::size keeps reporting the legacy size, so builds that only
+// understand kVRExternalVersion keep using the mutexes. Each side advertises
+// support by writing kVRExternalSeqLockVersion into its *SeqLockVersion field.
+// Writers increment generationA, copy the state and then set generationB to
+// match. Readers load generationB, copy the state and then load generationA,
+// retrying if the two differ.
+static const int32_t kVRExternalSeqLockVersion = 6;
+#endif  // defined(GFX_VR_ANDROID_LAYOUT) && defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+
 // We assign VR presentations to groups with a bitmask.
 // Currently, we will only display either content or chrome.
 // Later, we will have more groups to support VR home spaces and
@@ -55,7 +76,7 @@ static const int kVRControllerMaxAxis = 16;
 static const int kVRLayerMaxCount = 8;
 static const int kVRHapticsMaxCount = 32;
 
-#if defined(__ANDROID__)
+#if defined(GFX_VR_ANDROID_LAYOUT)
 typedef uint64_t VRLayerTextureHandle;
 #elif defined(XP_MACOSX)
 typedef uint32_t VRLayerTextureHandle;
@@ -369,9 +390,9 @@ struct VRHapticState {
 };
 
 struct VRBrowserState {
-#if defined(__ANDROID__)
+#if defined(GFX_VR_ANDROID_LAYOUT)
   bool shutdown;
-#endif  // defined(__ANDROID__)
+#endif  // defined(GFX_VR_ANDROID_LAYOUT)
   bool presentationActive;
   bool navigationTransitionActive;
   VRLayerState layerState[kVRLayerMaxCount];
@@ -388,23 +409,31 @@ struct VRSystemState {
 struct VRExternalShmem {
   int32_t version;
   int32_t size;
-#if defined(__ANDROID__)
+#if defined(GFX_VR_ANDROID_LAYOUT)
   pthread_mutex_t systemMutex;
   pthread_mutex_t browserMutex;
   pthread_cond_t systemCond;
   pthread_cond_t browserCond;
 #else
   int64_t generationA;
-#endif  // defined(__ANDROID__)
+#endif  // defined(GFX_VR_ANDROID_LAYOUT)
   VRSystemState state;
-#if !defined(__ANDROID__)
+#if !defined(GFX_VR_ANDROID_LAYOUT)
   int64_t generationB;
   int64_t browserGenerationA;
-#endif  // !defined(__ANDROID__)
+#endif  // !defined(GFX_VR_ANDROID_LAYOUT)
   VRBrowserState browserState;
-#if !defined(__ANDROID__)
+#if !defined(GFX_VR_ANDROID_LAYOUT)
+  int64_t browserGenerationB;
+#endif  // !defined(GFX_VR_ANDROID_LAYOUT)
+#if defined(GFX_VR_ANDROID_LAYOUT) && defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+  int32_t systemSeqLockVersion;
+  int32_t browserSeqLockVersion;
+  int64_t systemGenerationA;
+  int64_t systemGenerationB;
+  int64_t browserGenerationA;
   int64_t browserGenerationB;
-#endif  // !defined(__ANDROID__)
+#endif  // defined(GFX_VR_ANDROID_LAYOUT) && defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
 };
 
 // As we are memcpy'ing VRExternalShmem and its members around, it must be a POD
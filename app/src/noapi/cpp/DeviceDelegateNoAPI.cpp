@@ -5,6 +5,7 @@
 
 #include "DeviceDelegateNoAPI.h"
 #include "ElbowModel.h"
+#include "GLStateCache.h"
 #include "GestureDelegate.h"
 
 #include "vrb/CameraSimple.h"
@@ -177,10 +178,11 @@ DeviceDelegateNoAPI::ProcessEvents() {
 
 void
 DeviceDelegateNoAPI::StartFrame() {
-  VRB_GL_CHECK(glClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha()));
-  VRB_GL_CHECK(glEnable(GL_DEPTH_TEST));
-  VRB_GL_CHECK(glEnable(GL_CULL_FACE));
-  VRB_GL_CHECK(glEnable(GL_BLEND));
+  GLStateCache& glState = GLStateCache::Instance();
+  glState.ClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha());
+  glState.Enable(GL_DEPTH_TEST);
+  glState.Enable(GL_CULL_FACE);
+  glState.Enable(GL_BLEND);
   VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 }
 
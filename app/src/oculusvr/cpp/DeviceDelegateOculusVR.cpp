@@ -6,6 +6,7 @@
 #include "DeviceDelegateOculusVR.h"
 #include "DeviceUtils.h"
 #include "ElbowModel.h"
+#include "GLStateCache.h"
 #include "BrowserEGLContext.h"
 #include "VRLayer.h"
 
@@ -114,6 +115,76 @@ struct OculusEyeSwapChain {
   }
 };
 
+// glFramebufferTextureMultiviewOVR from GL_OVR_multiview, looked up at runtime.
+typedef void (*FramebufferTextureMultiviewFn)(GLenum aTarget, GLenum aAttachment, GLuint aTexture,
+                                              GLint aLevel, GLint aBaseViewIndex, GLsizei aNumViews);
+
+class OculusMultiviewSwapChain;
+
+typedef std::shared_ptr<OculusMultiviewSwapChain> OculusMultiviewSwapChainPtr;
+
+// Both eyes as the two layers of one texture array, rendered in a single pass with
+// OVR_multiview2. Only the immersive blit draws into it, without depth testing, so
+// the framebuffers have no depth attachment.
+struct OculusMultiviewSwapChain {
+  ovrTextureSwapChain *ovrSwapChain = nullptr;
+  int swapChainLength = 0;
+  std::vector<GLuint> framebuffers;
+
+  static OculusMultiviewSwapChainPtr create() {
+    return std::make_shared<OculusMultiviewSwapChain>();
+  }
+
+  bool Init(FramebufferTextureMultiviewFn aAttachMultiview, uint32_t aWidth, uint32_t aHeight) {
+    Destroy();
+    ovrSwapChain = vrapi_CreateTextureSwapChain(VRAPI_TEXTURE_TYPE_2D_ARRAY,
+                                                VRAPI_TEXTURE_FORMAT_8888,
+                                                aWidth, aHeight, 1, true);
+    if (!ovrSwapChain) {
+      VRB_LOG("FAILED to create multiview swap chain");
+      return false;
+    }
+    swapChainLength = vrapi_GetTextureSwapChainLength(ovrSwapChain);
+
+    for (int i = 0; i < swapChainLength; ++i) {
+      auto texture = vrapi_GetTextureSwapChainHandle(ovrSwapChain, i);
+      VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, texture));
+      VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+      VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+      VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+      VRB_GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+
+      GLuint framebuffer = 0;
+      VRB_GL_CHECK(glGenFramebuffers(1, &framebuffer));
+      framebuffers.push_back(framebuffer);
+      VRB_GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer));
+      VRB_GL_CHECK(aAttachMultiview(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, 0, VRAPI_EYE_COUNT));
+      const GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+      VRB_GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+      if (status != GL_FRAMEBUFFER_COMPLETE) {
+        VRB_LOG("FAILED to make valid multiview FBO: 0x%X", status);
+        VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+        Destroy();
+        return false;
+      }
+    }
+    VRB_GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    return true;
+  }
+
+  void Destroy() {
+    if (!framebuffers.empty()) {
+      VRB_GL_CHECK(glDeleteFramebuffers((GLsizei)framebuffers.size(), framebuffers.data()));
+      framebuffers.clear();
+    }
+    if (ovrSwapChain) {
+      vrapi_DestroyTextureSwapChain(ovrSwapChain);
+      ovrSwapChain = nullptr;
+    }
+    swapChainLength = 0;
+  }
+};
+
 template <class T, class U>
 class OculusLayer {
 public:
@@ -310,7 +381,7 @@ private:
       VRB_GL_CHECK(fboOut->SetTextureHandle(texture, layer->GetWidth(), layer->GetHeight(), attributes));
       if (fboOut->IsValid()) {
         fboOut->Bind();
-        VRB_GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+        GLStateCache::Instance().ClearColor(0.0f, 0.0f, 0.0f, 0.0f);
         VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
         fboOut->Unbind();
       } else {
@@ -476,6 +547,11 @@ struct DeviceDelegateOculusVR::State {
   ovrMobile* ovr = nullptr;
   ovrDeviceType deviceType;
   OculusEyeSwapChainPtr eyeSwapChains[VRAPI_EYE_COUNT];
+  // Set up in immersive mode when the context has GL_OVR_multiview2. Frames that bind
+  // it with BindMultiviewEyes submit it instead of the per eye swap chains.
+  OculusMultiviewSwapChainPtr multiviewSwapChain;
+  FramebufferTextureMultiviewFn framebufferTextureMultiview = nullptr;
+  bool multiviewFrame = false;
   OculusLayerCubePtr cubeLayer;
   OculusLayerEquirectPtr equirectLayer;
   std::vector<OculusLayerQuadPtr> uiLayers;
@@ -547,6 +623,7 @@ struct DeviceDelegateOculusVR::State {
       cameras[i] = vrb::CameraEye::Create(localContext->GetRenderThreadCreationContext());
       eyeSwapChains[i] = OculusEyeSwapChain::create();
     }
+    multiviewSwapChain = OculusMultiviewSwapChain::create();
     UpdatePerspective();
 
     reorientCount = vrapi_GetSystemStatusInt(&java, VRAPI_SYS_STATUS_RECENTER_COUNT);
@@ -579,6 +656,30 @@ struct DeviceDelegateOculusVR::State {
     }
   }
 
+  // Needs the GL context, so it runs once VR mode is entered.
+  void DetectMultiview() {
+    framebufferTextureMultiview = nullptr;
+    if (DeviceUtils::HasGLExtension("GL_OVR_multiview2")) {
+      framebufferTextureMultiview = (FramebufferTextureMultiviewFn)eglGetProcAddress("glFramebufferTextureMultiviewOVR");
+    }
+    VRB_LOG("OVR_multiview2 %s", framebufferTextureMultiview ? "supported" : "not supported, drawing each eye separately");
+  }
+
+  void InitSwapChains() {
+    vrb::RenderContextPtr render = context.lock();
+    for (int i = 0; i < VRAPI_EYE_COUNT; ++i) {
+      eyeSwapChains[i]->Init(render, renderMode, renderWidth, renderHeight);
+    }
+    // The loading animation still draws each eye on its own, so the per eye swap
+    // chains are kept next to the layered one.
+    if (renderMode == device::RenderMode::Immersive && framebufferTextureMultiview) {
+      multiviewSwapChain->Init(framebufferTextureMultiview, renderWidth, renderHeight);
+    } else {
+      multiviewSwapChain->Destroy();
+    }
+    multiviewFrame = false;
+  }
+
   void Shutdown() {
     // Shutdown Oculus mobile SDK
     if (initialized) {
@@ -757,10 +858,7 @@ DeviceDelegateOculusVR::SetRenderMode(const device::RenderMode aMode) {
   }
   m.renderMode = aMode;
   m.SetRenderSize(aMode);
-  vrb::RenderContextPtr render = m.context.lock();
-  for (int i = 0; i < VRAPI_EYE_COUNT; ++i) {
-    m.eyeSwapChains[i]->Init(render, m.renderMode, m.renderWidth, m.renderHeight);
-  }
+  m.InitSwapChains();
 
   // Reset reorient when exiting or entering immersive
   m.reorientMatrix = vrb::Matrix::Identity();
@@ -868,6 +966,7 @@ DeviceDelegateOculusVR::StartFrame() {
   }
 
   m.frameIndex++;
+  m.multiviewFrame = false;
   m.predictedDisplayTime = vrapi_GetPredictedDisplayTime(m.ovr, m.frameIndex);
   m.predictedTracking = vrapi_GetPredictedTracking2(m.ovr, m.predictedDisplayTime);
 
@@ -907,7 +1006,7 @@ DeviceDelegateOculusVR::StartFrame() {
     m.reorientMatrix = DeviceUtils::CalculateReorientationMatrix(head, kAverageHeight);
   }
 
-  VRB_GL_CHECK(glClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha()));
+  GLStateCache::Instance().ClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha());
 }
 
 void
@@ -944,6 +1043,30 @@ DeviceDelegateOculusVR::BindEye(const device::Eye aWhich) {
   }
 }
 
+bool
+DeviceDelegateOculusVR::IsMultiviewSupported() const {
+  return m.ovr && m.multiviewSwapChain->swapChainLength > 0;
+}
+
+void
+DeviceDelegateOculusVR::BindMultiviewEyes() {
+  if (!IsMultiviewSupported()) {
+    VRB_LOG("BindMultiviewEyes called without a multiview swap chain");
+    return;
+  }
+  if (m.currentFBO) {
+    m.currentFBO->Unbind();
+    m.currentFBO.reset();
+  }
+
+  const auto &swapChain = m.multiviewSwapChain;
+  const int swapChainIndex = m.frameIndex % swapChain->swapChainLength;
+  VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, swapChain->framebuffers[swapChainIndex]));
+  VRB_GL_CHECK(glViewport(0, 0, m.renderWidth, m.renderHeight));
+  VRB_GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+  m.multiviewFrame = true;
+}
+
 void
 DeviceDelegateOculusVR::EndFrame(const bool aDiscard) {
   if (!m.ovr) {
@@ -954,6 +1077,11 @@ DeviceDelegateOculusVR::EndFrame(const bool aDiscard) {
     m.currentFBO->Unbind();
     m.currentFBO.reset();
   }
+  const bool multiviewFrame = m.multiviewFrame;
+  if (multiviewFrame) {
+    VRB_GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    m.multiviewFrame = false;
+  }
 
   if (aDiscard) {
     return;
@@ -998,11 +1126,19 @@ DeviceDelegateOculusVR::EndFrame(const bool aDiscard) {
   projection.Header.SrcBlend = VRAPI_FRAME_LAYER_BLEND_ONE;
   projection.Header.DstBlend = VRAPI_FRAME_LAYER_BLEND_ONE_MINUS_SRC_ALPHA;
   for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
-    const auto &eyeSwapChain = m.eyeSwapChains[i];
-    const int swapChainIndex = m.frameIndex % eyeSwapChain->swapChainLength;
-    // Set up OVR layer textures
-    projection.Textures[i].ColorSwapChain = eyeSwapChain->ovrSwapChain;
-    projection.Textures[i].SwapChainIndex = swapChainIndex;
+    // Set up OVR layer textures. Both eyes of a multiview frame share the swap chain,
+    // the compositor takes each eye from its layer of the texture array.
+    ovrTextureSwapChain* swapChain;
+    int swapChainLength;
+    if (multiviewFrame) {
+      swapChain = m.multiviewSwapChain->ovrSwapChain;
+      swapChainLength = m.multiviewSwapChain->swapChainLength;
+    } else {
+      swapChain = m.eyeSwapChains[i]->ovrSwapChain;
+      swapChainLength = m.eyeSwapChains[i]->swapChainLength;
+    }
+    projection.Textures[i].ColorSwapChain = swapChain;
+    projection.Textures[i].SwapChainIndex = m.frameIndex % swapChainLength;
     projection.Textures[i].TexCoordsFromTanAngles = ovrMatrix4f_TanAngleMatrixFromProjection(&projectionMatrix);
   }
   layers[layerCount++] = &projection.Header;
@@ -1033,6 +1169,12 @@ DeviceDelegateOculusVR::EndFrame(const bool aDiscard) {
   vrapi_SubmitFrame2(m.ovr, &frameDesc);
 }
 
+double
+DeviceDelegateOculusVR::GetPredictedDisplayTime() const {
+  // vrapi_GetTimeInSeconds() is based on CLOCK_MONOTONIC.
+  return m.predictedDisplayTime;
+}
+
 VRLayerQuadPtr
 DeviceDelegateOculusVR::CreateLayerQuad(int32_t aWidth, int32_t aHeight,
                                         VRLayerQuad::SurfaceType aSurfaceType) {
@@ -1118,10 +1260,8 @@ DeviceDelegateOculusVR::EnterVR(const crow::BrowserEGLContext& aEGLContext) {
     return;
   }
 
-  vrb::RenderContextPtr render = m.context.lock();
-  for (int i = 0; i < VRAPI_EYE_COUNT; ++i) {
-    m.eyeSwapChains[i]->Init(render, m.renderMode, m.renderWidth, m.renderHeight);
-  }
+  m.DetectMultiview();
+  m.InitSwapChains();
   vrb::RenderContextPtr context = m.context.lock();
   for (OculusLayerQuadPtr& layer: m.uiLayers) {
     layer->Init(m.java.Env, context);
@@ -1168,6 +1308,8 @@ DeviceDelegateOculusVR::LeaveVR() {
   for (int i = 0; i < VRAPI_EYE_COUNT; ++i) {
     m.eyeSwapChains[i]->Destroy();
   }
+  m.multiviewSwapChain->Destroy();
+  m.multiviewFrame = false;
   for (OculusLayerQuadPtr& layer: m.uiLayers) {
     layer->Destroy(m.java.Env);
   }
@@ -40,7 +40,10 @@ public:
   void ProcessEvents() override;
   void StartFrame() override;
   void BindEye(const device::Eye aWhich) override;
+  bool IsMultiviewSupported() const override;
+  void BindMultiviewEyes() override;
   void EndFrame(const bool aDiscard) override;
+  double GetPredictedDisplayTime() const override;
   VRLayerQuadPtr CreateLayerQuad(int32_t aWidth, int32_t aHeight,
                                  VRLayerQuad::SurfaceType aSurfaceType) override;
   VRLayerCubePtr CreateLayerCube(int32_t aWidth, int32_t aHeight, GLint aInternalFormat) override;
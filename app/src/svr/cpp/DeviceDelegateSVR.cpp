@@ -5,6 +5,7 @@
 
 #include "DeviceDelegateSVR.h"
 #include "ElbowModel.h"
+#include "GLStateCache.h"
 #include "BrowserEGLContext.h"
 
 #include <android_native_app_glue.h>
@@ -102,6 +103,13 @@ struct DeviceDelegateSVR::State {
   uint32_t frameIndex = 0;
   svrHeadPoseState predictedPose = {};
   svrLayoutCoords layoutCoords = {};
+  // Immersive content submitted directly from Gecko's surface texture. The first
+  // submit decides whether the compositor takes it; if not, BrowserWorld blits.
+  GLuint externalTexture = 0;
+  bool externalLayerChecked = false;
+  bool externalLayerRejected = false;
+  svrLayoutCoords externalCoords[kNumEyes] = {};
+  svrHeadPoseState externalPose = {};
   uint32_t renderWidth = 0;
   uint32_t renderHeight = 0;
   vrb::Color clearColor;
@@ -138,6 +146,10 @@ struct DeviceDelegateSVR::State {
   }
 
   void UpdateLayoutCoords(float x, float y, float width, float height) {
+    SetLayoutCoords(layoutCoords, x, y, width, height);
+  }
+
+  static void SetLayoutCoords(svrLayoutCoords& aCoords, float x, float y, float width, float height) {
     // 0 = X-Position; 1 = Y-Position; 2 = Z-Position; 3 = Padding
     float lowerLeftPos[4] = { -1.0f, -1.0f, 0.0f, 1.0f };
     float lowerRightPos[4] = { 1.0f, -1.0f, 0.0f, 1.0f };
@@ -154,13 +166,13 @@ struct DeviceDelegateSVR::State {
                            0.0f, 0.0f, 1.0f, 0.0f,
                            0.0f, 0.0f, 0.0f, 1.0f };
 
-    memcpy(layoutCoords.LowerLeftPos, lowerLeftPos, sizeof(lowerLeftPos));
-    memcpy(layoutCoords.LowerRightPos, lowerRightPos, sizeof(lowerRightPos));
-    memcpy(layoutCoords.UpperLeftPos, upperLeftPos, sizeof(upperLeftPos));
-    memcpy(layoutCoords.UpperRightPos, upperRightPos, sizeof(upperRightPos));
-    memcpy(layoutCoords.LowerUVs, lowerUVs, sizeof(lowerUVs));
-    memcpy(layoutCoords.UpperUVs, upperUVs, sizeof(upperUVs));
-    memcpy(layoutCoords.TransformMatrix, transform, sizeof(transform));
+    memcpy(aCoords.LowerLeftPos, lowerLeftPos, sizeof(lowerLeftPos));
+    memcpy(aCoords.LowerRightPos, lowerRightPos, sizeof(lowerRightPos));
+    memcpy(aCoords.UpperLeftPos, upperLeftPos, sizeof(upperLeftPos));
+    memcpy(aCoords.UpperRightPos, upperRightPos, sizeof(upperRightPos));
+    memcpy(aCoords.LowerUVs, lowerUVs, sizeof(lowerUVs));
+    memcpy(aCoords.UpperUVs, upperUVs, sizeof(upperUVs));
+    memcpy(aCoords.TransformMatrix, transform, sizeof(transform));
   }
 
   void Initialize() {
@@ -442,7 +454,7 @@ DeviceDelegateSVR::StartFrame() {
   m.cameras[kRightEye]->SetHeadTransform(head);
 
   m.UpdateControllers(head);
-  VRB_GL_CHECK(glClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha()));
+  GLStateCache::Instance().ClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha());
 }
 
 void
@@ -510,7 +522,7 @@ DeviceDelegateSVR::EndFrame(const bool aDiscard) {
   // Options for adjusting the frame warp behavior (bitfield of svrFrameOption).
   params.frameOptions = 0;
   // Head pose state used to generate the frame.
-  params.headPoseState = m.predictedPose;
+  params.headPoseState = m.externalTexture ? m.externalPose : m.predictedPose;
   // Type of warp to be used on the frame.
   params.warpType = svrWarpType::kSimple;
   // Field of view used to generate this frame (larger than device fov to provide timewarp margin).
@@ -518,10 +530,18 @@ DeviceDelegateSVR::EndFrame(const bool aDiscard) {
   params.fieldOfView = 0.0;
 
   for (uint32_t eyeIndex = 0; eyeIndex < kNumEyes; eyeIndex++) {
-    uint32_t swapChainIndex = m.frameIndex % m.eyeSwapChains[eyeIndex]->swapChainLength;
-    params.renderLayers[eyeIndex].imageType = kTypeTexture;
-    params.renderLayers[eyeIndex].imageHandle = m.eyeSwapChains[eyeIndex]->textures[swapChainIndex];
-    params.renderLayers[eyeIndex].imageCoords = m.layoutCoords;
+    if (m.externalTexture) {
+      // svrApi.h documents kTypeImage as an EGL image texture, which the compositor
+      // samples through GL_TEXTURE_EXTERNAL_OES. A SurfaceTexture texture name is one.
+      params.renderLayers[eyeIndex].imageType = kTypeImage;
+      params.renderLayers[eyeIndex].imageHandle = m.externalTexture;
+      params.renderLayers[eyeIndex].imageCoords = m.externalCoords[eyeIndex];
+    } else {
+      uint32_t swapChainIndex = m.frameIndex % m.eyeSwapChains[eyeIndex]->swapChainLength;
+      params.renderLayers[eyeIndex].imageType = kTypeTexture;
+      params.renderLayers[eyeIndex].imageHandle = m.eyeSwapChains[eyeIndex]->textures[swapChainIndex];
+      params.renderLayers[eyeIndex].imageCoords = m.layoutCoords;
+    }
     if (eyeIndex == kLeftEye) {
       params.renderLayers[eyeIndex].eyeMask = kEyeMaskLeft;
     } else {
@@ -529,7 +549,41 @@ DeviceDelegateSVR::EndFrame(const bool aDiscard) {
     }
   }
 
-  svrSubmitFrame(&params);
+  const SvrResult result = svrSubmitFrame(&params);
+  if (m.externalTexture && !m.externalLayerChecked) {
+    m.externalLayerChecked = true;
+    if (result == SVR_ERROR_NONE) {
+      VRB_LOG("SVR accepted the external projection layer, immersive frames are not blitted");
+    } else {
+      VRB_LOG("SVR rejected the external projection layer (%d), immersive frames are blitted", result);
+      m.externalLayerRejected = true;
+      m.externalTexture = 0;
+    }
+  }
+}
+
+bool
+DeviceDelegateSVR::SetExternalProjectionLayer(const GLuint aTexture, const device::EyeRect& aLeftEye,
+                                              const device::EyeRect& aRightEye) {
+  if (!m.isInVRMode || m.renderMode != device::RenderMode::Immersive || !aTexture ||
+      m.externalLayerRejected) {
+    return false;
+  }
+  // Gecko's eye rects are measured from the top of the frame and the surface texture
+  // is stored upside down, so the lower edge of each eye maps to the larger v.
+  const device::EyeRect* eyes[kNumEyes] = {&aLeftEye, &aRightEye};
+  for (int i = 0; i < kNumEyes; ++i) {
+    const device::EyeRect& eye = *eyes[i];
+    m.SetLayoutCoords(m.externalCoords[i], eye.mX, eye.mY + eye.mHeight, eye.mWidth, -eye.mHeight);
+  }
+  m.externalTexture = aTexture;
+  m.externalPose = m.predictedPose;
+  return true;
+}
+
+void
+DeviceDelegateSVR::ClearExternalProjectionLayer() {
+  m.externalTexture = 0;
 }
 
 void
@@ -572,6 +626,7 @@ DeviceDelegateSVR::LeaveVR() {
     svrEndVr();
     m.isInVRMode = false;
   }
+  m.externalTexture = 0;
 
   for (int i = 0; i < kNumEyes; ++i) {
     m.eyeSwapChains[i]->Destroy();
@@ -41,6 +41,9 @@ public:
   void StartFrame() override;
   void BindEye(const device::Eye aWhich) override;
   void EndFrame(const bool aDiscard) override;
+  bool SetExternalProjectionLayer(const GLuint aTexture, const device::EyeRect& aLeftEye,
+                                  const device::EyeRect& aRightEye) override;
+  void ClearExternalProjectionLayer() override;
   // Custom methods for NativeActivity render loop based devices.
   void EnterVR(const crow::BrowserEGLContext& aEGLContext);
   void LeaveVR();
@@ -6,6 +6,7 @@
 #include "DeviceDelegateWaveVR.h"
 #include "DeviceUtils.h"
 #include "ElbowModel.h"
+#include "GLStateCache.h"
 #include "GestureDelegate.h"
 
 #include "vrb/CameraEye.h"
@@ -455,7 +456,7 @@ DeviceDelegateWaveVR::ProcessEvents() {
 
 void
 DeviceDelegateWaveVR::StartFrame() {
-  VRB_GL_CHECK(glClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha()));
+  GLStateCache::Instance().ClearColor(m.clearColor.Red(), m.clearColor.Green(), m.clearColor.Blue(), m.clearColor.Alpha());
   static const vrb::Vector kAverageHeight(0.0f, 1.7f, 0.0f);
   if (!m.lastSubmitDiscarded) {
     m.leftFBOIndex = WVR_GetAvailableTextureIndex(m.leftTextureQueue);
@@ -0,0 +1,100 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "FakeSurfaceProducer.h"
+
+FakeSurfaceProducer::FakeSurfaceProducer(const bool aDetectsDetach)
+    : mDetectsDetach(aDetectsDetach)
+    , mCurrentContext(nullptr)
+    , mAttachedContext(nullptr)
+    , mTexture(0)
+    , mQueuedFrame(0)
+    , mLatchedFrame(0)
+    , mHeld(false)
+    , mCalls(0)
+{}
+
+void
+FakeSurfaceProducer::MakeCurrent(void* aContext) {
+  mCurrentContext = aContext;
+}
+
+void
+FakeSurfaceProducer::QueueFrame() {
+  mQueuedFrame++;
+}
+
+void
+FakeSurfaceProducer::Steal(void* aContext) {
+  mAttachedContext = aContext;
+  mHeld = false;
+}
+
+bool
+FakeSurfaceProducer::IsAttached(void* aContext) {
+  mCalls++;
+  return mAttachedContext != nullptr && mAttachedContext == aContext;
+}
+
+bool
+FakeSurfaceProducer::Attach(void* aContext, const uint32_t aTexture) {
+  mCalls++;
+  if (aContext != mCurrentContext) {
+    Error("attached to a context that is not current");
+  }
+  if (aTexture == 0) {
+    Error("attached without a texture");
+  }
+  mAttachedContext = aContext;
+  mTexture = aTexture;
+  return true;
+}
+
+void
+FakeSurfaceProducer::Detach() {
+  mCalls++;
+  if (mAttachedContext != mCurrentContext) {
+    Error("detached from a context that is not current");
+  }
+  mAttachedContext = nullptr;
+  mHeld = false;
+}
+
+crow::SurfaceSource::UpdateResult
+FakeSurfaceProducer::Update() {
+  mCalls++;
+  if (mAttachedContext != mCurrentContext) {
+    if (mDetectsDetach) {
+      return UpdateResult::NotAttached;
+    }
+    // SurfaceTexture.updateTexImage through GeckoSurfaceTexture logs and carries on.
+    Error("updated while attached to another context");
+    return UpdateResult::Latched;
+  }
+  mLatchedFrame = mQueuedFrame;
+  mHeld = true;
+  return UpdateResult::Latched;
+}
+
+void
+FakeSurfaceProducer::Release() {
+  mCalls++;
+  if (!mHeld) {
+    Error("released without a latched frame");
+  }
+  mHeld = false;
+}
+
+bool
+FakeSurfaceProducer::DetectsDetach() const {
+  return mDetectsDetach;
+}
+
+void
+FakeSurfaceProducer::Error(const std::string& aMessage) {
+  if (mErrors.size() < 16) {
+    mErrors.push_back("frame " + std::to_string(mQueuedFrame) + ": " + aMessage);
+  }
+}
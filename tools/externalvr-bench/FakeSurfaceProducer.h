@@ -0,0 +1,55 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRBROWSER_FAKESURFACEPRODUCER_H
+#define VRBROWSER_FAKESURFACEPRODUCER_H
+
+#include "SurfaceLatch.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Stands in for a GeckoSurfaceTexture and the WebGL producer behind it. Frames are
+// numbered as they are queued, any consumer context may take the surface, and every
+// call a SurfaceLatch makes is counted and checked against what an Android
+// SurfaceTexture allows.
+class FakeSurfaceProducer : public crow::SurfaceSource {
+public:
+  explicit FakeSurfaceProducer(const bool aDetectsDetach);
+
+  // Plays eglGetCurrentContext for the consumer.
+  void MakeCurrent(void* aContext);
+  void QueueFrame();
+  // Another consumer, such as the Gecko compositor, attaches the surface.
+  void Steal(void* aContext);
+
+  uint64_t GetLatchedFrame() const { return mLatchedFrame; }
+  uint64_t GetQueuedFrame() const { return mQueuedFrame; }
+  uint64_t GetCalls() const { return mCalls; }
+  const std::vector<std::string>& GetErrors() const { return mErrors; }
+
+  bool IsAttached(void* aContext) override;
+  bool Attach(void* aContext, const uint32_t aTexture) override;
+  void Detach() override;
+  UpdateResult Update() override;
+  void Release() override;
+  bool DetectsDetach() const override;
+
+private:
+  void Error(const std::string& aMessage);
+
+  const bool mDetectsDetach;
+  void* mCurrentContext;
+  void* mAttachedContext;
+  uint32_t mTexture;
+  uint64_t mQueuedFrame;
+  uint64_t mLatchedFrame;
+  bool mHeld;
+  uint64_t mCalls;
+  std::vector<std::string> mErrors;
+};
+
+#endif // VRBROWSER_FAKESURFACEPRODUCER_H
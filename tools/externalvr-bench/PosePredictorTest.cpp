@@ -0,0 +1,149 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Drives PosePredictor with synthetic pose traces and checks its predictions
+// against the analytic motion. Exits with a non-zero status on failure.
+
+#include "PosePredictor.h"
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace crow;
+
+namespace {
+
+const double kFrameInterval = 1.0 / 90.0;
+int sFailures = 0;
+
+void
+Check(const bool aCondition, const char* aTest, const char* aMessage) {
+  if (!aCondition) {
+    fprintf(stderr, "FAIL %s: %s\n", aTest, aMessage);
+    sFailures++;
+  }
+}
+
+void
+YawQuaternion(const float aYaw, float aResult[4]) {
+  aResult[0] = 0.0f;
+  aResult[1] = sinf(aYaw * 0.5f);
+  aResult[2] = 0.0f;
+  aResult[3] = cosf(aYaw * 0.5f);
+}
+
+float
+QuaternionYaw(const float aQuaternion[4]) {
+  return 2.0f * atan2f(aQuaternion[1], aQuaternion[3]);
+}
+
+// Feeds aCount samples of a head turning at aYawRate rad/s while moving at aSpeed m/s along x.
+void
+FeedTrace(PosePredictor& aPredictor, const int aCount, const float aYawRate, const float aSpeed) {
+  for (int frame = 0; frame < aCount; frame++) {
+    const double time = frame * kFrameInterval;
+    float orientation[4];
+    YawQuaternion(aYawRate * (float)time, orientation);
+    const float position[3] = {aSpeed * (float)time, 1.6f, 0.0f};
+    aPredictor.AddSample((uint64_t)frame + 1, time, orientation, position);
+  }
+}
+
+void
+TestStaticPose() {
+  PosePredictorPtr predictor = PosePredictor::Create();
+  FeedTrace(*predictor, 30, 0.0f, 0.0f);
+  PoseSample result;
+  Check(predictor->Predict(1.0, result), __FUNCTION__, "no prediction");
+  Check(fabsf(QuaternionYaw(result.orientation)) < 1e-5f, __FUNCTION__, "static orientation drifted");
+  Check(fabsf(result.position[0]) < 1e-5f && fabsf(result.position[1] - 1.6f) < 1e-5f, __FUNCTION__,
+        "static position drifted");
+}
+
+void
+TestConstantYaw() {
+  const float yawRate = 2.0f;
+  PosePredictorPtr predictor = PosePredictor::Create();
+  FeedTrace(*predictor, 30, yawRate, 0.0f);
+  const double newest = 29 * kFrameInterval;
+  const double ahead = 0.03;
+  PoseSample result;
+  predictor->Predict(newest + ahead, result);
+  const float expected = yawRate * (float)(newest + ahead);
+  Check(fabsf(QuaternionYaw(result.orientation) - expected) < 1e-3f, __FUNCTION__, "yaw not extrapolated");
+  Check(fabsf(result.angularVelocity[1] - yawRate) < 1e-2f, __FUNCTION__, "angular velocity not measured");
+}
+
+void
+TestLinearMotion() {
+  const float speed = 1.5f;
+  PosePredictorPtr predictor = PosePredictor::Create();
+  FeedTrace(*predictor, 30, 0.0f, speed);
+  const double newest = 29 * kFrameInterval;
+  PoseSample result;
+  predictor->Predict(newest + 0.02, result);
+  Check(fabsf(result.position[0] - speed * (float)(newest + 0.02)) < 1e-3f, __FUNCTION__,
+        "position not extrapolated");
+}
+
+void
+TestPredictionLimit() {
+  const float yawRate = 1.0f;
+  PosePredictorPtr predictor = PosePredictor::Create();
+  FeedTrace(*predictor, 30, yawRate, 0.0f);
+  const double newest = 29 * kFrameInterval;
+  PoseSample result;
+  predictor->Predict(newest + 10.0, result);
+  // Extrapolation stops 100 ms after the newest sample.
+  Check(fabsf(QuaternionYaw(result.orientation) - yawRate * (float)(newest + 0.1)) < 1e-3f, __FUNCTION__,
+        "prediction not limited");
+  predictor->Predict(newest - 0.5, result);
+  Check(result.time == newest, __FUNCTION__, "past times must return the newest sample");
+}
+
+void
+TestDuplicateTimestamp() {
+  const float yawRate = 1.0f;
+  PosePredictorPtr predictor = PosePredictor::Create();
+  FeedTrace(*predictor, 30, yawRate, 0.0f);
+  const double newest = 29 * kFrameInterval;
+  float orientation[4];
+  YawQuaternion(yawRate * (float)newest, orientation);
+  const float position[3] = {0.0f, 1.6f, 0.0f};
+  const PoseSample& sample = predictor->AddSample(31, newest, orientation, position);
+  Check(fabsf(sample.angularVelocity[1] - yawRate) < 1e-2f, __FUNCTION__, "velocity lost on a repeated sample");
+}
+
+void
+TestFindSample() {
+  PosePredictorPtr predictor = PosePredictor::Create();
+  PoseSample result;
+  Check(!predictor->FindSample(0, result), __FUNCTION__, "found a sample before any was added");
+  Check(!predictor->FindSample(~(uint64_t)0, result), __FUNCTION__, "found the unwritten marker");
+  FeedTrace(*predictor, 100, 1.0f, 0.0f);
+  Check(predictor->FindSample(100, result) && result.inputFrameID == 100, __FUNCTION__, "newest sample missing");
+  Check(!predictor->FindSample(20, result), __FUNCTION__, "found an overwritten sample");
+  predictor->Reset();
+  Check(!predictor->FindSample(100, result), __FUNCTION__, "found a sample after Reset");
+  Check(!predictor->Predict(1.0, result), __FUNCTION__, "predicted after Reset");
+}
+
+} // namespace
+
+int
+main(int, char**) {
+  TestStaticPose();
+  TestConstantYaw();
+  TestLinearMotion();
+  TestPredictionLimit();
+  TestDuplicateTimestamp();
+  TestFindSample();
+  if (sFailures > 0) {
+    fprintf(stderr, "%d check(s) failed\n", sFailures);
+    return 1;
+  }
+  printf("PosePredictor: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,20 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// The parts of VRBrowser used by ExternalVR. There is no Java side on the host.
+
+#include "VRBrowser.h"
+
+namespace crow {
+namespace VRBrowser {
+
+void
+PauseCompositor() {}
+
+void
+ResumeCompositor() {}
+
+} // namespace VRBrowser
+} // namespace crow
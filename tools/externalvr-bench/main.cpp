@@ -0,0 +1,431 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Benchmarks the ExternalVR shared memory protocol without a headset or a Gecko
+// build. A fake Gecko thread starts a presentation and submits immersive frames at a
+// configurable rate and jitter, while the main thread plays the render thread and
+// drives the real ExternalVR class the way BrowserWorld::DrawImmersive does.
+//
+// With --surface-latch it instead drives SurfaceLatch against a fake surface producer,
+// once as the ASurfaceTexture path and once as the JNI path, and checks every call.
+
+#include "ExternalVR.h"
+#include "FakeSurfaceProducer.h"
+#include "ImmersiveTelemetry.h"
+#include "moz_external_vr.h"
+
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+using namespace crow;
+
+namespace {
+
+struct Options {
+  double displayRate = 72.0;
+  double contentRate = 60.0;
+  double jitter = 0.002;
+  double duration = 10.0;
+  bool seqLock = false;
+  bool surfaceLatch = false;
+  std::string dumpPath;
+};
+
+// Lock and publish costs, in seconds.
+struct TimingStats {
+  uint64_t count = 0;
+  uint64_t contended = 0;
+  double total = 0.0;
+  double max = 0.0;
+
+  void Add(const double aSeconds, const double aContendedThreshold) {
+    count++;
+    total += aSeconds;
+    max = std::max(max, aSeconds);
+    if (aSeconds > aContendedThreshold) {
+      contended++;
+    }
+  }
+
+  void Print(const char* aName) const {
+    printf("  %-24s count %8llu  avg %8.2f us  max %8.2f us  contended %llu\n", aName,
+           (unsigned long long)count, count ? (total / count) * 1e6 : 0.0, max * 1e6,
+           (unsigned long long)contended);
+  }
+};
+
+// An uncontended pthread mutex is taken in well under this.
+const double kContendedLock = 0.00002;
+
+double
+Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+void
+SleepUntil(const double aTime) {
+  struct timespec ts;
+  ts.tv_sec = time_t(aTime);
+  ts.tv_nsec = long((aTime - double(ts.tv_sec)) * 1e9);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0) {}
+}
+
+class FakeGecko {
+public:
+  FakeGecko(mozilla::gfx::VRExternalShmem* aShmem, const Options& aOptions)
+      : mShmem(aShmem)
+      , mOptions(aOptions)
+      , mQuit(false)
+      , mSubmitted(0)
+      , mSeqLockRetries(0)
+  {}
+
+  void Start() {
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    if (mOptions.seqLock) {
+      __atomic_store_n(&mShmem->browserSeqLockVersion, mozilla::gfx::kVRExternalSeqLockVersion, __ATOMIC_RELEASE);
+    }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    mThread = std::thread([this] { Run(); });
+  }
+
+  void Stop() {
+    mQuit = true;
+    mThread.join();
+  }
+
+  uint64_t GetSubmittedFrames() const { return mSubmitted; }
+  uint64_t GetSeqLockRetries() const { return mSeqLockRetries; }
+  const TimingStats& GetSystemLockStats() const { return mSystemLock; }
+  const TimingStats& GetBrowserLockStats() const { return mBrowserLock; }
+
+private:
+  void Run() {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<double> jitter(-mOptions.jitter, mOptions.jitter);
+    const double interval = 1.0 / mOptions.contentRate;
+
+    mBrowser = mozilla::gfx::VRBrowserState();
+    mBrowser.presentationActive = true;
+    mBrowser.layerState[0].type = mozilla::gfx::VRLayerType::LayerType_Stereo_Immersive;
+    mozilla::gfx::VRLayer_Stereo_Immersive& layer = mBrowser.layerState[0].layer_stereo_immersive;
+    layer.mTextureHandle = 1;
+    layer.mLeftEyeRect = {0.0f, 0.0f, 0.5f, 1.0f};
+    layer.mRightEyeRect = {0.5f, 0.0f, 0.5f, 1.0f};
+
+    double next = Now();
+    while (!mQuit) {
+      // Content reads the latest pose at the start of its frame and renders with it.
+      ReadSystemState();
+      next += std::max(0.0, interval + jitter(random));
+      SleepUntil(next);
+      layer.mFrameId++;
+      layer.mInputFrameId = mSystem.sensorState.inputFrameID;
+      WriteBrowserState();
+      mSubmitted++;
+    }
+
+    mBrowser.presentationActive = false;
+    mBrowser.layerState[0].type = mozilla::gfx::VRLayerType::LayerType_None;
+    WriteBrowserState();
+  }
+
+  void ReadSystemState() {
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    if (mOptions.seqLock) {
+      while (true) {
+        const int64_t generationB = __atomic_load_n(&mShmem->systemGenerationB, __ATOMIC_ACQUIRE);
+        memcpy(&mSystem, &mShmem->state, sizeof(mSystem));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&mShmem->systemGenerationA, __ATOMIC_RELAXED) == generationB) {
+          return;
+        }
+        mSeqLockRetries++;
+      }
+    }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    const double start = Now();
+    pthread_mutex_lock(&mShmem->systemMutex);
+    mSystemLock.Add(Now() - start, kContendedLock);
+    memcpy(&mSystem, &mShmem->state, sizeof(mSystem));
+    pthread_mutex_unlock(&mShmem->systemMutex);
+  }
+
+  void WriteBrowserState() {
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    if (mOptions.seqLock) {
+      const int64_t generation = mShmem->browserGenerationA + 1;
+      __atomic_store_n(&mShmem->browserGenerationA, generation, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      memcpy(&mShmem->browserState, &mBrowser, sizeof(mBrowser));
+      __atomic_store_n(&mShmem->browserGenerationB, generation, __ATOMIC_RELEASE);
+      return;
+    }
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    const double start = Now();
+    pthread_mutex_lock(&mShmem->browserMutex);
+    mBrowserLock.Add(Now() - start, kContendedLock);
+    memcpy(&mShmem->browserState, &mBrowser, sizeof(mBrowser));
+    pthread_cond_signal(&mShmem->browserCond);
+    pthread_mutex_unlock(&mShmem->browserMutex);
+  }
+
+  mozilla::gfx::VRExternalShmem* mShmem;
+  const Options& mOptions;
+  std::thread mThread;
+  std::atomic<bool> mQuit;
+  std::atomic<uint64_t> mSubmitted;
+  uint64_t mSeqLockRetries;
+  mozilla::gfx::VRSystemState mSystem;
+  mozilla::gfx::VRBrowserState mBrowser;
+  TimingStats mSystemLock;
+  TimingStats mBrowserLock;
+};
+
+void
+PrintSummary(const ImmersiveTelemetryPtr& aTelemetry, const TelemetryMetric aMetric, const char* aUnit) {
+  const ImmersiveTelemetry::Summary summary = aTelemetry->GetSummary(aMetric);
+  printf("  %-24s count %8llu  p50 %6lld  p90 %6lld  p99 %6lld  max %6lld %s\n", TelemetryMetricName(aMetric),
+         (unsigned long long)summary.count, (long long)summary.p50, (long long)summary.p90,
+         (long long)summary.p99, (long long)summary.max, aUnit);
+}
+
+void
+Usage(const char* aName) {
+  printf("Usage: %s [options]\n"
+         "  --display-rate HZ   Simulated display refresh rate (default 72)\n"
+         "  --content-rate HZ   Rate at which the fake Gecko submits frames (default 60)\n"
+         "  --jitter MS         Uniform jitter added to each content frame (default 2)\n"
+         "  --duration S        Length of the presentation (default 10)\n"
+         "  --seqlock           Use the seqlock protocol instead of the pthread mutexes, needs\n"
+         "                      a build with -DSHMEM_SEQLOCK_EXTENSION=ON\n"
+         "  --dump PATH         Write the immersive telemetry CSV to PATH\n"
+         "  --surface-latch     Check SurfaceLatch against a fake surface producer\n", aName);
+}
+
+bool
+ParseOptions(int aArgc, char** aArgv, Options& aOptions) {
+  for (int index = 1; index < aArgc; index++) {
+    const std::string arg = aArgv[index];
+    const bool hasValue = index + 1 < aArgc;
+    if (arg == "--seqlock") {
+#if defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+      aOptions.seqLock = true;
+#else
+      fprintf(stderr, "--seqlock needs a build with -DSHMEM_SEQLOCK_EXTENSION=ON\n");
+      return false;
+#endif // defined(VRBROWSER_SHMEM_SEQLOCK_EXTENSION)
+    } else if (arg == "--surface-latch") {
+      aOptions.surfaceLatch = true;
+    } else if (arg == "--display-rate" && hasValue) {
+      aOptions.displayRate = atof(aArgv[++index]);
+    } else if (arg == "--content-rate" && hasValue) {
+      aOptions.contentRate = atof(aArgv[++index]);
+    } else if (arg == "--jitter" && hasValue) {
+      aOptions.jitter = atof(aArgv[++index]) * 0.001;
+    } else if (arg == "--duration" && hasValue) {
+      aOptions.duration = atof(aArgv[++index]);
+    } else if (arg == "--dump" && hasValue) {
+      aOptions.dumpPath = aArgv[++index];
+    } else {
+      return false;
+    }
+  }
+  return aOptions.displayRate > 0.0 && aOptions.contentRate > 0.0 && aOptions.duration > 0.0;
+}
+
+// Latches one frame per display frame, plus a content layer surface every other
+// frame, while the Gecko compositor occasionally takes the released immersive surface.
+bool
+CheckSurfaceLatch(const Options& aOptions, const bool aNative) {
+  static int sRenderContext;
+  static int sGeckoContext;
+  const uint32_t kTexture = 1;
+  const uint32_t kStealInterval = 97;
+  std::shared_ptr<FakeSurfaceProducer> immersive = std::make_shared<FakeSurfaceProducer>(aNative);
+  std::shared_ptr<FakeSurfaceProducer> layer = std::make_shared<FakeSurfaceProducer>(aNative);
+  SurfaceLatchPtr immersiveLatch = SurfaceLatch::Create(immersive);
+  SurfaceLatchPtr layerLatch = SurfaceLatch::Create(layer);
+  immersive->MakeCurrent(&sRenderContext);
+  layer->MakeCurrent(&sRenderContext);
+
+  const uint64_t frames = uint64_t(aOptions.duration * aOptions.displayRate);
+  uint64_t stale = 0;
+  for (uint64_t frame = 1; frame <= frames; frame++) {
+    immersive->QueueFrame();
+    immersiveLatch->Release();
+    if ((frame % kStealInterval) == 0) {
+      immersive->Steal(&sGeckoContext);
+    }
+    if (immersiveLatch->Latch(&sRenderContext, kTexture) && immersive->GetLatchedFrame() != immersive->GetQueuedFrame()) {
+      stale++;
+    }
+    if ((frame % 2) == 0) {
+      layer->QueueFrame();
+      if (layerLatch->Latch(&sRenderContext, kTexture) && layer->GetLatchedFrame() != layer->GetQueuedFrame()) {
+        stale++;
+      }
+      layerLatch->Release();
+    }
+  }
+  immersiveLatch->Release();
+  immersiveLatch->Detach(&sRenderContext);
+  layerLatch->Detach(&sRenderContext);
+
+  const SurfaceLatch::Stats& stats = immersiveLatch->GetStats();
+  printf("%s path, %llu frames\n", aNative ? "ASurfaceTexture" : "JNI", (unsigned long long)frames);
+  printf("  immersive surface calls per frame %.2f, content layer calls per latch %.2f\n",
+         double(immersive->GetCalls()) / double(frames), double(layer->GetCalls()) / double(frames / 2));
+  printf("  latched %llu, failed %llu, attached %llu, attach queries %llu, released %llu, skipped releases %llu\n",
+         (unsigned long long)stats.latched, (unsigned long long)stats.failed, (unsigned long long)stats.attached,
+         (unsigned long long)stats.attachQueries, (unsigned long long)stats.released,
+         (unsigned long long)stats.skippedReleases);
+  bool result = stale == 0;
+  if (stale > 0) {
+    printf("  ERROR %llu frames latched a stale buffer\n", (unsigned long long)stale);
+  }
+  for (const FakeSurfaceProducer* producer: {immersive.get(), layer.get()}) {
+    for (const std::string& error: producer->GetErrors()) {
+      printf("  ERROR %s\n", error.c_str());
+      result = false;
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+int
+main(int aArgc, char** aArgv) {
+  Options options;
+  if (!ParseOptions(aArgc, aArgv, options)) {
+    Usage(aArgv[0]);
+    return 1;
+  }
+
+  if (options.surfaceLatch) {
+    const bool native = CheckSurfaceLatch(options, true);
+    const bool jni = CheckSurfaceLatch(options, false);
+    return native && jni ? 0 : 1;
+  }
+
+  ExternalVRPtr externalVR = ExternalVR::Create();
+  externalVR->SetEyeResolution(1440, 1600);
+  externalVR->CompleteEnumeration();
+  externalVR->PushSystemState();
+
+  FakeGecko gecko(externalVR->GetSharedData(), options);
+  gecko.Start();
+
+  // Two tracked controllers whose poses change every frame while buttons change rarely,
+  // as they do in a real session.
+  std::vector<Controller> controllers(2);
+  for (size_t index = 0; index < controllers.size(); index++) {
+    Controller& controller = controllers[index];
+    controller.index = (int32_t)index;
+    controller.enabled = true;
+    controller.immersiveName = "Bench Controller";
+    controller.numButtons = 2;
+    controller.numAxes = 2;
+    controller.leftHanded = index == 0;
+  }
+  const double interval = 1.0 / options.displayRate;
+  TimingStats pull, push, wait;
+  uint64_t displayFrames = 0;
+  uint64_t newFrames = 0;
+  const double start = Now();
+  double vsync = start;
+  bool presented = false;
+  while (vsync - start < options.duration) {
+    // Compositors predict the frame being started to be displayed one frame after the next vsync.
+    const double displayTime = vsync + 2.0 * interval;
+    double timer = Now();
+    externalVR->PullBrowserState();
+    pull.Add(Now() - timer, kContendedLock);
+    if (externalVR->IsPresenting()) {
+      presented = true;
+      timer = Now();
+      for (Controller& controller: controllers) {
+        controller.transformMatrix = vrb::Matrix::Rotation(vrb::Vector(1.0f, 0.0f, 0.0f), float(vsync - start));
+      }
+      if ((displayFrames % 90) == 0) {
+        Controller& controller = controllers[0];
+        controller.immersivePressedState ^= 1;
+        controller.immersiveTriggerValues[0] = controller.immersivePressedState ? 1.0f : 0.0f;
+        controller.immersiveDirty |= kImmersiveButtonsDirty;
+      }
+      externalVR->PushFramePoses(vrb::Matrix::Rotation(vrb::Vector(0.0f, 1.0f, 0.0f), float(vsync - start)),
+                                 controllers, displayTime);
+      push.Add(Now() - timer, kContendedLock);
+      timer = Now();
+      if (externalVR->WaitFrameResult(displayTime)) {
+        newFrames++;
+      }
+      wait.Add(Now() - timer, interval);
+      int32_t surfaceHandle = 0;
+      device::EyeRect leftEye, rightEye;
+      externalVR->GetFrameResult(surfaceHandle, leftEye, rightEye);
+    }
+    displayFrames++;
+    vsync += interval;
+    SleepUntil(vsync);
+  }
+  const double elapsed = Now() - start;
+  gecko.Stop();
+
+  if (!presented) {
+    fprintf(stderr, "The fake Gecko never started presenting\n");
+    return 1;
+  }
+
+  uint32_t presentedFrames = 0;
+  uint32_t missedDeadlines = 0;
+  externalVR->GetFrameHandoffStats(presentedFrames, missedDeadlines);
+  const ImmersiveTelemetryPtr& telemetry = externalVR->GetTelemetry();
+  printf("ExternalVR %s protocol, display %.1f Hz, content %.1f Hz, jitter %.1f ms, %.2f s\n",
+         options.seqLock ? "seqlock" : "mutex", options.displayRate, options.contentRate,
+         options.jitter * 1000.0, elapsed);
+  printf("Throughput\n");
+  printf("  display frames %llu (%.1f Hz), content submitted %llu (%.1f Hz), presented %u (%.1f Hz)\n",
+         (unsigned long long)displayFrames, displayFrames / elapsed,
+         (unsigned long long)gecko.GetSubmittedFrames(), gecko.GetSubmittedFrames() / elapsed,
+         presentedFrames, presentedFrames / elapsed);
+  printf("  new frames %llu, missed deadlines %u, skipped %llu, repeated %llu\n",
+         (unsigned long long)newFrames, missedDeadlines, (unsigned long long)telemetry->GetSkippedFrames(),
+         (unsigned long long)telemetry->GetRepeatedFrames());
+  printf("Latency\n");
+  PrintSummary(telemetry, TelemetryMetric::FrameWait, "us");
+  PrintSummary(telemetry, TelemetryMetric::PoseLatency, "us");
+  PrintSummary(telemetry, TelemetryMetric::FrameIdDelta, "frames");
+  printf("Render thread (contended means over 20 us, or a full frame for WaitFrameResult)\n");
+  pull.Print("PullBrowserState");
+  push.Print("PushFramePoses");
+  wait.Print("WaitFrameResult");
+  printf("Gecko thread\n");
+  if (options.seqLock) {
+    printf("  system state read retries %llu\n", (unsigned long long)gecko.GetSeqLockRetries());
+  } else {
+    gecko.GetSystemLockStats().Print("systemMutex lock");
+    gecko.GetBrowserLockStats().Print("browserMutex lock");
+  }
+
+  if (!options.dumpPath.empty()) {
+    telemetry->DumpToFile(options.dumpPath);
+  }
+  return 0;
+}
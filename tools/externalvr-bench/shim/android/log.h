@@ -0,0 +1,37 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Routes the Android log calls made by vrb/Logger.h to stderr on the host.
+
+#ifndef EXTERNALVR_BENCH_ANDROID_LOG_H
+#define EXTERNALVR_BENCH_ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+enum android_LogPriority {
+  ANDROID_LOG_UNKNOWN = 0,
+  ANDROID_LOG_DEFAULT,
+  ANDROID_LOG_VERBOSE,
+  ANDROID_LOG_DEBUG,
+  ANDROID_LOG_INFO,
+  ANDROID_LOG_WARN,
+  ANDROID_LOG_ERROR,
+  ANDROID_LOG_FATAL,
+  ANDROID_LOG_SILENT
+};
+
+inline int
+__android_log_print(int aPriority, const char* aTag, const char* aFormat, ...) {
+  fprintf(stderr, "%s%s: ", aPriority >= ANDROID_LOG_ERROR ? "E " : "", aTag);
+  va_list args;
+  va_start(args, aFormat);
+  const int result = vfprintf(stderr, aFormat, args);
+  va_end(args);
+  fputc('\n', stderr);
+  return result;
+}
+
+#endif // EXTERNALVR_BENCH_ANDROID_LOG_H
@@ -0,0 +1,158 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Compares how BrowserWorld finds widgets as the widget count grows: the linear
+// std::function scan over the widget vector it used to do, and the handle and surface
+// name hash maps it uses now. vrb does not build for the host, so the widgets are
+// stand-ins that answer GetHandle and GetSurfaceTextureName the way crow::Widget does.
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+class FakeWidget {
+public:
+  explicit FakeWidget(const int32_t aHandle)
+      : mHandle(aHandle), mName("crow::Widget-" + std::to_string(aHandle)) {}
+  virtual ~FakeWidget() {}
+  virtual int32_t GetHandle() const { return mHandle; }
+  virtual const std::string& GetSurfaceTextureName() const { return mName; }
+private:
+  int32_t mHandle;
+  std::string mName;
+};
+typedef std::shared_ptr<FakeWidget> FakeWidgetPtr;
+
+// The lookups made by the JNI entry points: updateWidgetNative and removeWidgetNative
+// find one widget by handle, layoutWidgetNative finds the widget and its parent and
+// setSurfaceTexture finds one by surface name.
+struct Request {
+  int32_t handle;
+  int32_t parent;
+  std::string name;
+};
+
+struct ScanIndex {
+  std::vector<FakeWidgetPtr> widgets;
+
+  FakeWidgetPtr Find(const std::function<bool(const FakeWidgetPtr&)>& aCondition) const {
+    for (const FakeWidgetPtr& widget: widgets) {
+      if (aCondition(widget)) {
+        return widget;
+      }
+    }
+    return {};
+  }
+
+  FakeWidgetPtr Get(const int32_t aHandle) const {
+    return Find([=](const FakeWidgetPtr& aWidget) {
+      return aWidget->GetHandle() == aHandle;
+    });
+  }
+
+  FakeWidgetPtr GetBySurfaceName(const std::string& aName) const {
+    return Find([&](const FakeWidgetPtr& aWidget) {
+      return aName == aWidget->GetSurfaceTextureName();
+    });
+  }
+};
+
+struct MapIndex {
+  std::vector<FakeWidgetPtr> widgets;
+  std::unordered_map<int32_t, FakeWidgetPtr> byHandle;
+  std::unordered_map<std::string, FakeWidgetPtr> bySurfaceName;
+
+  FakeWidgetPtr Get(const int32_t aHandle) const {
+    auto iter = byHandle.find(aHandle);
+    return iter != byHandle.end() ? iter->second : nullptr;
+  }
+
+  FakeWidgetPtr GetBySurfaceName(const std::string& aName) const {
+    auto iter = bySurfaceName.find(aName);
+    return iter != bySurfaceName.end() ? iter->second : nullptr;
+  }
+};
+
+double
+Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+// Returns nanoseconds per request. aFound keeps the lookups from being optimized away.
+template <typename Index>
+double
+Run(const Index& aIndex, const std::vector<Request>& aRequests, const int aRounds, uint64_t& aFound) {
+  const double start = Now();
+  for (int round = 0; round < aRounds; round++) {
+    for (const Request& request: aRequests) {
+      aFound += aIndex.Get(request.handle) ? 1 : 0;
+      aFound += aIndex.Get(request.parent) ? 1 : 0;
+      aFound += aIndex.GetBySurfaceName(request.name) ? 1 : 0;
+    }
+  }
+  return (Now() - start) * 1e9 / (double(aRounds) * aRequests.size());
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  int rounds = 200;
+  for (int index = 1; index < argc; index++) {
+    const std::string arg = argv[index];
+    if (arg == "--rounds" && index + 1 < argc) {
+      rounds = std::max(1, atoi(argv[++index]));
+    } else {
+      printf("Usage: %s [--rounds N]\n", argv[0]);
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  const int counts[] = {1, 10, 50, 100, 250, 500};
+  const size_t kRequests = 1000;
+  std::mt19937 random(1);
+  uint64_t found = 0;
+  printf("%8s %14s %14s %8s\n", "widgets", "scan ns/call", "map ns/call", "speedup");
+  for (const int count: counts) {
+    ScanIndex scan;
+    MapIndex map;
+    for (int32_t handle = 1; handle <= count; handle++) {
+      FakeWidgetPtr widget = std::make_shared<FakeWidget>(handle);
+      scan.widgets.push_back(widget);
+      map.widgets.push_back(widget);
+      map.byHandle[handle] = widget;
+      map.bySurfaceName[widget->GetSurfaceTextureName()] = widget;
+    }
+    std::uniform_int_distribution<int32_t> handles(1, count);
+    std::vector<Request> requests(kRequests);
+    for (Request& request: requests) {
+      request.handle = handles(random);
+      request.parent = handles(random);
+      request.name = "crow::Widget-" + std::to_string(handles(random));
+    }
+    const double scanTime = Run(scan, requests, rounds, found);
+    const double mapTime = Run(map, requests, rounds, found);
+    printf("%8d %14.1f %14.1f %7.1fx\n", count, scanTime, mapTime, scanTime / mapTime);
+  }
+  // Every request names existing widgets.
+  const uint64_t expected = 2ull * 3ull * uint64_t(rounds) * kRequests * (sizeof(counts) / sizeof(counts[0]));
+  if (found != expected) {
+    fprintf(stderr, "Lookups failed: %llu of %llu found\n", (unsigned long long)found,
+            (unsigned long long)expected);
+    return 1;
+  }
+  return 0;
+}